@@ -0,0 +1,212 @@
+//
+//  adaptive.c
+//  API for one-pass adaptive Huffman coding (FGK algorithm)
+//  coder and decoder grow the same tree symbol by symbol, no table is sent
+//
+
+#include <string.h>
+#include "adaptive.h"
+#include "encode.h"
+#include "decode.h"
+
+// prototypes for private functions used in adaptive.c only
+void adaptive_add(adaptive_t *, int);
+void adaptive_increment(adaptive_t *, int);
+void adaptive_swap(adaptive_t *, int, int);
+
+/* Resets a model to the empty tree both ends start an archive with
+ */
+void adaptive_init(adaptive_t *model) {
+    memset(model->leaf, -1, sizeof(model->leaf));
+
+    // the escape keeps a weight of 1, so no node ever weighs as much as its
+    // parent and the block leader FGK swaps with is never an ancestor
+    model->node[0].weight = 1;
+    model->node[0].parent = -1;
+    model->node[0].child = 0;
+    model->node[0].sym = -1;
+    model->escape = 0;
+    model->num_nodes = 1;
+}
+
+/* Counts symbols into a model without coding them, as both ends do for a
+ * block stored raw
+ */
+void adaptive_update(adaptive_t *model, const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++) adaptive_add(model, in[i]);
+}
+
+/******************************************************************************
+adaptive_encode:
+Purpose:      Codes a buffer of symbols, updating the model after each one
+Parameters:   model - tree carried over from the previous symbols
+              in, len - symbols to code
+              out - buffer of at least limit + 48 bytes
+              limit - most bytes the coded symbols may take
+              out_len - receives the bytes stored
+Return:       0 on success, -1 if the symbols need more than limit bytes, in
+              which case the model has moved on by an unknown number of them
+Notes:        a code is the path from the root to the symbol's leaf, 0 for
+              the first child; a symbol not seen before is sent as the path
+              to the escape leaf followed by its 8 bits
+******************************************************************************/
+int adaptive_encode(adaptive_t *model, const unsigned char *in, size_t len, unsigned char *out, size_t limit,
+                    size_t *out_len) {
+    const adaptive_node_t *node = model->node;
+    unsigned char path[ADAPTIVE_NODES];
+    bit_writer_t bw;
+    uint64_t code;
+    size_t i;
+    int n, p, depth, j, k, sym;
+
+    bit_writer_init(&bw, out);
+
+    for (i = 0; i < len; i++) {
+        sym = in[i];
+        n = model->leaf[sym] >= 0 ? model->leaf[sym] : model->escape;
+
+        // branches are found leaf first and sent root first
+        for (depth = 0; n != 0; n = p) {
+            p = node[n].parent;
+            path[depth++] = n - node[p].child;
+        }
+
+        while (depth > 0) {
+            k = depth < 32 ? depth : 32;
+            for (code = 0, j = 0; j < k; j++) code = code << 1 | path[--depth];
+            bit_writer_put(&bw, code, k);
+        }
+
+        if (model->leaf[sym] < 0) bit_writer_put(&bw, sym, 8);
+
+        if ((size_t)(bw.ptr - out) > limit) return -1;
+
+        adaptive_add(model, sym);
+    }
+
+    bit_writer_flush(&bw);
+    if ((size_t)(bw.ptr - out) > limit) return -1;
+
+    *out_len = bw.ptr - out;
+    return 0;
+}
+
+/******************************************************************************
+adaptive_decode:
+Purpose:      Decodes a buffer of symbols, updating the model after each one
+Parameters:   model - tree carried over from the previous symbols
+              in, len - coded symbols
+              out, num_syms - buffer for the decoded symbols
+Return:       0 on success, -1 if an escape names a symbol already seen
+Notes:        the walk from the root takes one bit per branch; past the end
+              of the input the bits read as zeros, as for decode_symbols
+******************************************************************************/
+int adaptive_decode(adaptive_t *model, const unsigned char *in, size_t len, unsigned char *out, size_t num_syms) {
+    const adaptive_node_t *node = model->node;
+    bit_reader_t br;
+    size_t i;
+    int n, sym;
+
+    bit_reader_init(&br, in, len);
+
+    for (i = 0; i < num_syms; i++) {
+        for (n = 0; node[n].child != 0; n = node[n].child + (int)(br.bits >> 63), br.bits <<= 1, br.count--) {
+            if (br.count < 1) bit_reader_fill(&br);
+        }
+
+        if (n == model->escape) {
+            if (br.count < 8) bit_reader_fill(&br);
+            sym = br.bits >> 56;
+            br.bits <<= 8;
+            br.count -= 8;
+            if (model->leaf[sym] >= 0) return -1;
+        } else {
+            sym = node[n].sym;
+        }
+
+        out[i] = sym;
+        adaptive_add(model, sym);
+    }
+
+    return 0;
+}
+
+/* Adds one occurrence of a symbol to the tree, giving it a leaf first if it
+ * has none
+ */
+void adaptive_add(adaptive_t *model, int sym) {
+    adaptive_node_t *node = model->node;
+    int z = model->escape, n = model->num_nodes, q = model->leaf[sym];
+
+    // the escape leaf splits into itself and a leaf of weight 0 for the
+    // symbol, both added last so the increment below keeps the order
+    if (q < 0) {
+        node[z].child = n;
+        node[n].weight = 1;
+        node[n].parent = z;
+        node[n].child = 0;
+        node[n].sym = -1;
+        node[n + 1].weight = 0;
+        node[n + 1].parent = z;
+        node[n + 1].child = 0;
+        node[n + 1].sym = sym;
+        model->escape = n;
+        model->leaf[sym] = q = n + 1;
+        model->num_nodes += 2;
+    }
+
+    adaptive_increment(model, q);
+}
+
+/* Adds one to the weight of a node and of each of its ancestors, first
+ * swapping each with the leader of its block, the lowest numbered node of
+ * the same weight, so the nodes stay in order of weight
+ */
+void adaptive_increment(adaptive_t *model, int q) {
+    adaptive_node_t *node = model->node;
+    uint64_t w;
+    int l;
+
+    for (; q >= 0; q = node[q].parent) {
+        w = node[q].weight;
+        for (l = q; l > 0 && node[l - 1].weight == w; l--);
+
+        if (l != q) {
+            adaptive_swap(model, l, q);
+            q = l;
+        }
+        node[q].weight++;
+    }
+}
+
+/* Exchanges the subtrees at two nodes of the same weight, neither an
+ * ancestor of the other; each node keeps its place under its parent
+ */
+void adaptive_swap(adaptive_t *model, int a, int b) {
+    adaptive_node_t *node = model->node;
+    int child = node[a].child, sym = node[a].sym;
+
+    node[a].child = node[b].child;
+    node[a].sym = node[b].sym;
+    node[b].child = child;
+    node[b].sym = sym;
+
+    if (node[a].child != 0) {
+        node[node[a].child].parent = node[node[a].child + 1].parent = a;
+    } else if (node[a].sym >= 0) {
+        model->leaf[node[a].sym] = a;
+    }
+
+    if (node[b].child != 0) {
+        node[node[b].child].parent = node[node[b].child + 1].parent = b;
+    } else if (node[b].sym >= 0) {
+        model->leaf[node[b].sym] = b;
+    }
+
+    if (model->escape == a)
+        model->escape = b;
+    else if (model->escape == b)
+        model->escape = a;
+}
@@ -0,0 +1,41 @@
+//
+//  adaptive.h
+//  API for one-pass adaptive Huffman coding (FGK algorithm)
+//  coder and decoder grow the same tree symbol by symbol, no table is sent
+//
+
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "codes.h"
+
+#define ADAPTIVE_NODES (2 * NUM_SYMS + 1)   // every symbol seen, plus the escape leaf
+
+// a node of the tree; nodes sit in order of non-increasing weight, so the
+// numbering FGK swaps along is the array order, node 0 being the root
+typedef struct adaptive_node_tag {
+    uint64_t weight;
+    int parent;           // -1 at the root
+    int child;            // children at child and child + 1, 0 for a leaf
+    int sym;              // symbol of a leaf
+} adaptive_node_t;
+
+// the tree starts as the lone escape leaf; a symbol not seen before is sent
+// as the escape code followed by its 8 bits, then gets a leaf of its own
+typedef struct adaptive_tag {
+    adaptive_node_t node[ADAPTIVE_NODES];
+    int leaf[NUM_SYMS];   // node of each symbol, -1 until it is seen
+    int escape;           // node of the escape leaf
+    int num_nodes;
+} adaptive_t;
+
+// public prototype definitions for adaptive.c
+void adaptive_init(adaptive_t *model);
+void adaptive_update(adaptive_t *model, const unsigned char *in, size_t len);
+int adaptive_encode(adaptive_t *model, const unsigned char *in, size_t len, unsigned char *out, size_t limit,
+                    size_t *out_len);
+int adaptive_decode(adaptive_t *model, const unsigned char *in, size_t len, unsigned char *out, size_t num_syms);
+
+#endif
@@ -0,0 +1,386 @@
+//
+//  bench.c
+//  API for timing the codec stage by stage on an input held in memory
+//  blocks are coded and decoded with the block layer directly
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "bench.h"
+#include "block.h"
+#include "libhuff.h"
+
+const char *bench_stage_name[BENCH_STAGES] = {
+    "histogram", "code build", "encode", "table build", "decode"
+};
+
+// stage names as CSV columns and JSON keys
+const char *bench_stage_key[BENCH_STAGES] = {
+    "histogram", "code_build", "encode", "table_build", "decode"
+};
+
+// names of HUFF_MODE_STATIC, HUFF_MODE_ADAPTIVE and HUFF_MODE_ORDER1
+const char *bench_mode_name[3] = { "static", "adaptive", "order1" };
+
+// buffers and coder state shared by every run
+typedef struct bench_state_tag {
+    const unsigned char *in;
+    size_t len;
+    size_t block_size;
+    unsigned char *archive;
+    size_t archive_len;
+    unsigned char *out;
+    block_encoder_t enc;
+    block_index_t idx;
+    block_decoder_t dec;
+} bench_state_t;
+
+// prototypes for private functions used in bench.c only
+double bench_now(void);
+double bench_rate(double, double);
+int bench_stage_run(const bench_result_t *, int);
+void bench_report_text(FILE *, const char *, const bench_result_t *);
+void bench_report_csv(FILE *, const char *, const bench_result_t *);
+void bench_report_json(FILE *, const char *, const bench_result_t *);
+double bench_entropy(const unsigned char *, size_t);
+int bench_compress(bench_state_t *, double *);
+int bench_decompress(bench_state_t *, double *);
+
+/******************************************************************************
+bench_run:
+Purpose:      Compresses and decompresses an input repeatedly, timing each
+              stage
+Parameters:   in, len - input held in memory
+              block_size, max_len, num_streams, mode - coding settings,
+                                                       as for the archive
+              iterations - timed runs
+              res - receives the totals over all timed runs
+Return:       0 on success, -1 if a run does not restore the input or
+              memory runs out
+Notes:        one untimed run first warms caches and lookup tables; every
+              run is checked against the input outside the timed stages
+******************************************************************************/
+int bench_run(const unsigned char *in, size_t len, size_t block_size, int max_len, int num_streams, int mode,
+              int iterations, bench_result_t *res) {
+    bench_state_t st;
+    double t;
+    int i, status = 0;
+
+    memset(res, 0, sizeof(bench_result_t));
+    memset(&st, 0, sizeof(bench_state_t));
+    res->iterations = iterations;
+    res->raw_len = len;
+    res->block_size = block_size;
+    res->max_len = max_len;
+    res->num_streams = num_streams;
+    res->mode = mode;
+    res->entropy = bench_entropy(in, len);
+
+    st.in = in;
+    st.len = len;
+    st.block_size = block_size;
+    st.archive = (unsigned char *)malloc(huff_compress_bound(len));
+    st.out = (unsigned char *)malloc(len ? len : 1);
+    st.enc.max_len = max_len;
+    st.enc.num_streams = num_streams;
+    st.enc.mode = mode == HUFF_MODE_ADAPTIVE ? BLOCK_ADAPTIVE : mode == HUFF_MODE_ORDER1 ? BLOCK_ORDER1 : BLOCK_STATIC;
+    block_index_init(&st.idx);
+    block_decoder_init(&st.dec);
+    if (st.archive == NULL || st.out == NULL) status = -1;
+
+    for (i = -1; i < iterations && status == 0; i++) {
+        double stage_time[BENCH_STAGES] = {0};
+
+        t = bench_now();
+        if (bench_compress(&st, stage_time) != 0) status = -1;
+        if (i >= 0) res->compress_time += bench_now() - t;
+        if (status != 0) break;
+
+        memset(st.out, 0, len);
+        t = bench_now();
+        status = bench_decompress(&st, stage_time);
+        if (i >= 0) res->decompress_time += bench_now() - t;
+
+        if (status == 0 && memcmp(st.out, in, len) != 0) status = -1;
+
+        // the warm-up run is not counted
+        if (i >= 0) {
+            int s;
+            for (s = 0; s < BENCH_STAGES; s++) res->stage_time[s] += stage_time[s];
+        }
+    }
+
+    res->comp_len = st.archive_len;
+    res->num_blocks = st.idx.num_blocks;
+
+    block_encoder_free(&st.enc);
+    block_decoder_free(&st.dec);
+    block_index_free(&st.idx);
+    free(st.archive);
+    free(st.out);
+    return status;
+}
+
+/* Prints the results of bench_run as text, one CSV record with its header,
+ * or one JSON object per line
+ */
+void bench_report(FILE *fpt, const char *name, const bench_result_t *res, int format) {
+    if (format == BENCH_CSV)
+        bench_report_csv(fpt, name, res);
+    else if (format == BENCH_JSON)
+        bench_report_json(fpt, name, res);
+    else
+        bench_report_text(fpt, name, res);
+}
+
+// throughput of each stage, the ratio and the entropy bound, for reading
+void bench_report_text(FILE *fpt, const char *name, const bench_result_t *res) {
+    double mb = (double)res->raw_len * res->iterations / 1e6;
+    double bound = res->entropy * res->raw_len / 8;
+    int s;
+
+    fprintf(fpt, "%s: %llu bytes, %llu %s blocks of %d stream%s, %d iterations\n", name,
+            (unsigned long long)res->raw_len, (unsigned long long)res->num_blocks, bench_mode_name[res->mode],
+            res->num_streams, res->num_streams > 1 ? "s" : "", res->iterations);
+    fprintf(fpt, "  %-12s %10s %10s\n", "stage", "MB/s", "ms/run");
+
+    for (s = 0; s < BENCH_STAGES; s++) {
+        if (!bench_stage_run(res, s)) {
+            fprintf(fpt, "  %-12s %10s %10s\n", bench_stage_name[s], "n/a", "n/a");
+            continue;
+        }
+        fprintf(fpt, "  %-12s %10.1f %10.3f\n", bench_stage_name[s], bench_rate(mb, res->stage_time[s]),
+                1e3 * res->stage_time[s] / res->iterations);
+    }
+
+    fprintf(fpt, "  %-12s %10.1f %10.3f\n", "compress", bench_rate(mb, res->compress_time),
+            1e3 * res->compress_time / res->iterations);
+    fprintf(fpt, "  %-12s %10.1f %10.3f\n", "decompress", bench_rate(mb, res->decompress_time),
+            1e3 * res->decompress_time / res->iterations);
+
+    fprintf(fpt, "  ratio %.2f%% (%llu bytes, %.3f bits/byte)\n",
+            res->raw_len ? 100.0 * res->comp_len / res->raw_len : 0.0, (unsigned long long)res->comp_len,
+            res->raw_len ? 8.0 * res->comp_len / res->raw_len : 0.0);
+    fprintf(fpt, "  entropy bound %.0f bytes (%.3f bits/byte), archive is %.2f%% %s\n", bound, res->entropy,
+            bound > 0 ? 100.0 * fabs(res->comp_len - bound) / bound : 0.0, res->comp_len < bound ? "under" : "over");
+}
+
+// header line and one record, fields in the same order as the JSON keys
+void bench_report_csv(FILE *fpt, const char *name, const bench_result_t *res) {
+    double mb = (double)res->raw_len * res->iterations / 1e6;
+    const char *c;
+    int s;
+
+    fprintf(fpt, "name,raw_len,comp_len,blocks,block_size,max_len,streams,mode,iterations,bits_per_byte,entropy");
+    for (s = 0; s < BENCH_STAGES; s++) fprintf(fpt, ",%s_mbps,%s_ms", bench_stage_key[s], bench_stage_key[s]);
+    fprintf(fpt, ",compress_mbps,compress_ms,decompress_mbps,decompress_ms\n");
+
+    // quoted, with quotes doubled
+    fputc('"', fpt);
+    for (c = name; *c != '\0'; c++) {
+        if (*c == '"') fputc('"', fpt);
+        fputc(*c, fpt);
+    }
+    fputc('"', fpt);
+
+    fprintf(fpt, ",%llu,%llu,%llu,%llu,%d,%d,\"%s\",%d,%.4f,%.4f", (unsigned long long)res->raw_len,
+            (unsigned long long)res->comp_len, (unsigned long long)res->num_blocks,
+            (unsigned long long)res->block_size, res->max_len, res->num_streams, bench_mode_name[res->mode],
+            res->iterations, res->raw_len ? 8.0 * res->comp_len / res->raw_len : 0.0, res->entropy);
+    for (s = 0; s < BENCH_STAGES; s++) {
+        if (!bench_stage_run(res, s)) {
+            fprintf(fpt, ",,");
+            continue;
+        }
+        fprintf(fpt, ",%.2f,%.4f", bench_rate(mb, res->stage_time[s]), 1e3 * res->stage_time[s] / res->iterations);
+    }
+    fprintf(fpt, ",%.2f,%.4f,%.2f,%.4f\n", bench_rate(mb, res->compress_time),
+            1e3 * res->compress_time / res->iterations, bench_rate(mb, res->decompress_time),
+            1e3 * res->decompress_time / res->iterations);
+}
+
+// one JSON object on one line
+void bench_report_json(FILE *fpt, const char *name, const bench_result_t *res) {
+    double mb = (double)res->raw_len * res->iterations / 1e6;
+    const char *c;
+    int s;
+
+    // control characters and quotes escaped
+    fprintf(fpt, "{\"name\":\"");
+    for (c = name; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(fpt, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20)
+            fprintf(fpt, "\\u%04x", *c);
+        else
+            fputc(*c, fpt);
+    }
+    fputc('"', fpt);
+
+    fprintf(fpt, ",\"raw_len\":%llu,\"comp_len\":%llu,\"blocks\":%llu,\"block_size\":%llu,\"max_len\":%d,\"streams\":%d",
+            (unsigned long long)res->raw_len, (unsigned long long)res->comp_len,
+            (unsigned long long)res->num_blocks, (unsigned long long)res->block_size, res->max_len,
+            res->num_streams);
+    fprintf(fpt, ",\"mode\":\"%s\"", bench_mode_name[res->mode]);
+    fprintf(fpt, ",\"iterations\":%d,\"bits_per_byte\":%.4f,\"entropy\":%.4f", res->iterations,
+            res->raw_len ? 8.0 * res->comp_len / res->raw_len : 0.0, res->entropy);
+    for (s = 0; s < BENCH_STAGES; s++) {
+        if (!bench_stage_run(res, s)) {
+            fprintf(fpt, ",\"%s_mbps\":null,\"%s_ms\":null", bench_stage_key[s], bench_stage_key[s]);
+            continue;
+        }
+        fprintf(fpt, ",\"%s_mbps\":%.2f,\"%s_ms\":%.4f", bench_stage_key[s], bench_rate(mb, res->stage_time[s]),
+                bench_stage_key[s], 1e3 * res->stage_time[s] / res->iterations);
+    }
+    fprintf(fpt, ",\"compress_mbps\":%.2f,\"compress_ms\":%.4f,\"decompress_mbps\":%.2f,\"decompress_ms\":%.4f}\n",
+            bench_rate(mb, res->compress_time), 1e3 * res->compress_time / res->iterations,
+            bench_rate(mb, res->decompress_time), 1e3 * res->decompress_time / res->iterations);
+}
+
+// monotonic clock in seconds
+double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// megabytes per second, 0 for a stage that took no measurable time
+double bench_rate(double mb, double seconds) {
+    return seconds > 0 ? mb / seconds : 0.0;
+}
+
+// whether the coding mode has a stage at all, adaptive archives are coded
+// and decoded in one step with no tables
+int bench_stage_run(const bench_result_t *res, int stage) {
+    return res->mode != HUFF_MODE_ADAPTIVE || stage == BENCH_ENCODE || stage == BENCH_DECODE;
+}
+
+// order-0 entropy of a buffer in bits per byte
+double bench_entropy(const unsigned char *in, size_t len) {
+    hist_t hist;
+    double p, h = 0.0;
+    int i;
+
+    hist_reset(&hist);
+    hist_update(&hist, in, len);
+
+    for (i = 0; i < HIST_SYMS; i++) {
+        if (hist.count[i] == 0) continue;
+        p = (double)hist.count[i] / len;
+        h -= p * log2(p);
+    }
+
+    return h;
+}
+
+/******************************************************************************
+bench_compress:
+Purpose:      Codes the input into an archive in memory
+Parameters:   st - benchmark state, st->archive receives the archive
+              stage_time - seconds are added to the compression stages
+Return:       0 on success, -1 if out of memory
+Notes:        same steps and output as block_compress on one thread; an
+              adaptive archive has no separate stages, all its coding time
+              counts as encoding
+******************************************************************************/
+int bench_compress(bench_state_t *st, double *stage_time) {
+    block_job_t *job = &st->enc.job;
+    unsigned char *out = st->archive;
+    size_t pos, n, stored, size = BLOCK_FILE_HEADER;
+    double t0, t1, t2, t3;
+
+    block_encoder_init(&st->enc, st->enc.max_len, st->enc.num_streams, st->enc.mode);
+    block_index_reset(&st->idx);
+    block_write_file_header(out, st->block_size, st->enc.mode);
+
+    for (pos = 0; pos < st->len; pos += n) {
+        n = st->len - pos < st->block_size ? st->len - pos : st->block_size;
+
+        if (st->enc.mode == BLOCK_ADAPTIVE) {
+            t0 = bench_now();
+            stored = block_compress(&st->enc, st->in + pos, n, out + size);
+            stage_time[BENCH_ENCODE] += bench_now() - t0;
+            if (stored == 0) return -1;
+
+            if (block_index_add(&st->idx, out + size) != 0) return -1;
+            size += stored;
+            continue;
+        }
+
+        t0 = bench_now();
+        hist_reset(&job->hist);
+        hist_update(&job->hist, st->in + pos, n);
+        t1 = bench_now();
+        if (block_build_table(job, st->enc.max_len) != 0) return -1;
+        if (st->enc.mode == BLOCK_ORDER1)
+            block_build_context(job, st->enc.max_len, block_split(&st->enc, n), st->in + pos, n);
+        t2 = bench_now();
+        block_choose(&st->enc, job);
+        stored = block_encode(job, st->in + pos, n, out + size);
+        t3 = bench_now();
+
+        stage_time[BENCH_HIST] += t1 - t0;
+        stage_time[BENCH_BUILD] += t2 - t1;
+        stage_time[BENCH_ENCODE] += t3 - t2;
+
+        // index memory is reused from the previous run
+        if (block_index_add(&st->idx, out + size) != 0) return -1;
+        size += stored;
+    }
+
+    out[size++] = BLOCK_END;
+    block_index_store(&st->idx, out + size);
+    st->archive_len = size + block_index_size(&st->idx);
+    return 0;
+}
+
+/******************************************************************************
+bench_decompress:
+Purpose:      Decodes the archive in memory back to st->out
+Parameters:   st - benchmark state after bench_compress
+              stage_time - seconds are added to the decompression stages
+Return:       0 on success, -1 if a block is malformed
+Notes:        same steps as block_decompress, with the table build, single
+              or order-1, split out
+******************************************************************************/
+int bench_decompress(bench_state_t *st, double *stage_time) {
+    const unsigned char *payload;
+    size_t raw_len, comp_len;
+    uint64_t i, raw_offset = 0;
+    int flags, table_len, status;
+    double t0, t1, t2;
+
+    block_decoder_start(&st->dec, st->enc.mode);
+
+    for (i = 0; i < st->idx.num_blocks; i++) {
+        payload = st->archive + st->idx.entry[i].offset;
+        if (block_read_header(payload, &flags, &raw_len, &comp_len) != 0) return -1;
+        payload += BLOCK_HEADER;
+
+        t0 = bench_now();
+        table_len = 0;
+        if (flags & BLOCK_CONTEXT) {
+            if ((table_len = block_load_context(&st->dec, payload, comp_len)) < 0) return -1;
+        } else if (flags & BLOCK_TABLE) {
+            if ((table_len = block_load_table(&st->dec, payload, comp_len)) < 0) return -1;
+        }
+        t1 = bench_now();
+        if (flags & BLOCK_CONTEXT)
+            status = block_decode(&st->dec, flags, payload + table_len, comp_len - table_len,
+                                  st->out + raw_offset, raw_len);
+        else
+            status = block_decompress(&st->dec, flags & ~BLOCK_TABLE, payload + table_len, comp_len - table_len,
+                                      st->out + raw_offset, raw_len);
+        if (status != 0) return -1;
+        t2 = bench_now();
+
+        stage_time[BENCH_TABLE] += t1 - t0;
+        stage_time[BENCH_DECODE] += t2 - t1;
+        raw_offset += raw_len;
+    }
+
+    return 0;
+}
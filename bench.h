@@ -0,0 +1,49 @@
+//
+//  bench.h
+//  API for timing the codec stage by stage on an input held in memory
+//  blocks are coded and decoded with the block layer directly
+//
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// stages timed separately
+#define BENCH_HIST 0              // symbol counting
+#define BENCH_BUILD 1             // tree and code construction
+#define BENCH_ENCODE 2            // table choice and bit packing
+#define BENCH_TABLE 3             // decoder lookup table construction
+#define BENCH_DECODE 4            // symbol decoding
+#define BENCH_STAGES 5
+
+// report formats
+#define BENCH_TEXT 0
+#define BENCH_CSV 1
+#define BENCH_JSON 2
+
+typedef struct bench_result_tag {
+    int iterations;               // timed runs, after one warm-up run
+    uint64_t raw_len;             // bytes of input
+    uint64_t comp_len;            // bytes of archive
+    uint64_t num_blocks;
+    uint64_t block_size;
+    int max_len;
+    int num_streams;              // bitstreams per coded block
+    int mode;                     // HUFF_MODE_STATIC, HUFF_MODE_ADAPTIVE or HUFF_MODE_ORDER1
+    double entropy;               // order-0 entropy of the input, bits per byte
+    double stage_time[BENCH_STAGES];  // seconds in each stage over all runs
+    double compress_time;         // seconds in whole compression runs
+    double decompress_time;       // seconds in whole decompression runs
+} bench_result_t;
+
+extern const char *bench_stage_name[BENCH_STAGES];
+
+// public prototype definitions for bench.c
+int bench_run(const unsigned char *in, size_t len, size_t block_size, int max_len, int num_streams, int mode,
+              int iterations, bench_result_t *res);
+void bench_report(FILE *fpt, const char *name, const bench_result_t *res, int format);
+
+#endif
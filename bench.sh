@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+#  bench.sh
+#  Runs the codec benchmark over synthetic inputs and the bundled samples
+#  usage: ./bench.sh [size ...]   (K/M/G suffixes, default 1K 64K 1M 16M 256M)
+#
+#  results go to bench-results.csv and bench-results.json, one record per
+#  input and coding mode tagged with the commit, so runs can be compared
+#  across commits; every input is coded with per-block tables, with the
+#  adaptive tree and with order-1 tables, override with BENCH_MODES="static"
+#
+#  GiB inputs are left out of the default sizes: pass them explicitly, as in
+#  ./bench.sh 1G 4G or make bench BENCH_SIZES="1G 4G". Each run holds about
+#  three times the input in memory, and takes around 15 minutes per GiB
+#  across the distributions, most of it in the adaptive mode
+#
+
+set -e
+
+DISTS="uniform zipf geometric single two random text image"
+SIZES=${*:-"1K 64K 1M 16M 256M"}
+MODES=${BENCH_MODES:-"static adaptive order1"}
+OUT=${BENCH_OUT:-bench-results}
+HUFF=$(pwd)/huff
+GEN=$(pwd)/huffgen
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+DIR=$(mktemp -d "${TMPDIR:-/tmp}/huffbench.XXXXXX")
+trap 'rm -rf "$DIR"' EXIT
+
+# bytes in a size with an optional K/M/G suffix
+bytes() {
+    case $1 in
+    *K|*k) echo $(( ${1%?} << 10 )) ;;
+    *M|*m) echo $(( ${1%?} << 20 )) ;;
+    *G|*g) echo $(( ${1%?} << 30 )) ;;
+    *) echo "$1" ;;
+    esac
+}
+
+# enough runs to code about 256M, at least one and at most 50
+runs() {
+    n=$(( (256 << 20) / $(bytes "$1") ))
+    [ "$n" -lt 1 ] && n=1
+    [ "$n" -gt 50 ] && n=50
+    echo "$n"
+}
+
+# benchmark one file in each mode, appending its records to the CSV results
+run() {
+    for mode in $MODES; do
+        flag=
+        [ "$mode" = adaptive ] && flag=-A
+        [ "$mode" = order1 ] && flag=-O
+        (cd "$(dirname "$1")" && "$HUFF" -b $flag -N "$2" -F csv "$(basename "$1")") | tail -n 1 |
+            sed "s/^/\"$COMMIT\",/" >> "$OUT.csv"
+        tail -n 1 "$OUT.csv" | cut -d, -f2,9,11,23,25 | tr -d '"' | tr ',' '\t'
+    done
+}
+
+# header only, from a one-byte input
+printf 'a' > "$DIR/header"
+"$HUFF" -b -N 1 -F csv "$DIR/header" | head -n 1 | sed 's/^/commit,/' > "$OUT.csv"
+
+echo "name	mode	bits/byte	compress MB/s	decompress MB/s"
+for size in $SIZES; do
+    for dist in $DISTS; do
+        "$GEN" "$dist" "$size" > "$DIR/$dist-$size"
+        run "$DIR/$dist-$size" "$(runs "$size")"
+        rm -f "$DIR/$dist-$size"
+    done
+done
+
+for file in declaration.txt golfcore.ppm hello; do
+    run "$(pwd)/$file" 50
+done
+
+# same records as a JSON array, names from the CSV header, stages a mode
+# does not run as null
+awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) key[i] = $i; print "["; next }
+         { printf "%s  {", (NR > 2 ? ",\n" : "")
+           for (i = 1; i <= NF; i++) printf "%s\"%s\": %s", (i > 1 ? ", " : ""), key[i], ($i == "" ? "null" : $i)
+           printf "}" }
+         END { print "\n]" }' "$OUT.csv" > "$OUT.json"
+
+echo "results in $OUT.csv and $OUT.json"
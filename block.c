@@ -0,0 +1,873 @@
+//
+//  block.c
+//  API for the block-based .huf container
+//  input is split into independently coded blocks, each with its own table
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "block.h"
+#include "encode.h"
+#include "stats.h"
+
+// prototypes for private functions used in block.c only
+void calc_freq(const uint64_t *, list_t *);
+void build_codes(list_t *, huffman_codes_t *, int, uint64_t *);
+int build_table_codes(block_job_t *, const uint64_t *, uint64_t, int, huffman_codes_t *, uint64_t *);
+int compare(const data_t *, const data_t *);
+int compare_freq(const data_t *, const data_t *);
+int block_streams(int);
+size_t substream_start(size_t, int, int);
+int read_substreams(const block_decoder_t *, int, const unsigned char *, size_t, unsigned char *, size_t);
+size_t block_compress_adaptive(block_encoder_t *, const unsigned char *, size_t, unsigned char *);
+
+/* Returns the most bytes block_compress can store for a block of raw_len
+ * bytes, including header, table and encoder slack.
+ */
+size_t block_bound(size_t raw_len) {
+    return BLOCK_HEADER + CODES_MAX_HEADER + raw_len + 8;
+}
+
+// store a 32-bit value, little Endian
+void block_put32(unsigned char *out, uint32_t val) {
+    out[0] = val;
+    out[1] = val >> 8;
+    out[2] = val >> 16;
+    out[3] = val >> 24;
+}
+
+// store a 64-bit value, little Endian
+void block_put64(unsigned char *out, uint64_t val) {
+    block_put32(out, val);
+    block_put32(out + 4, val >> 32);
+}
+
+// load a 64-bit value, little Endian
+uint64_t block_get64(const unsigned char *in) {
+    return block_get32(in) | (uint64_t)block_get32(in + 4) << 32;
+}
+
+// load a 32-bit value, little Endian
+uint32_t block_get32(const unsigned char *in) {
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+/* Stores the file header for an archive of blocks of up to block_size bytes,
+ * the version telling which mode the archive is coded in
+ */
+void block_write_file_header(unsigned char *out, size_t block_size, int mode) {
+    memcpy(out, BLOCK_MAGIC, 3);
+    out[3] = mode == BLOCK_ADAPTIVE ? BLOCK_VERSION_ADAPTIVE : BLOCK_VERSION;
+    block_put32(out + 4, block_size);
+}
+
+/* Checks the magic and version of a file header
+ *
+ * Return: 0 on success, -1 if this is not a .huf archive this version reads
+ */
+int block_read_file_header(const unsigned char *in, size_t *block_size, int *mode) {
+    if (memcmp(in, BLOCK_MAGIC, 3) != 0 || (in[3] != BLOCK_VERSION && in[3] != BLOCK_VERSION_ADAPTIVE)) return -1;
+
+    *mode = in[3] == BLOCK_VERSION_ADAPTIVE ? BLOCK_ADAPTIVE : BLOCK_STATIC;
+    *block_size = block_get32(in + 4);
+    if (*block_size < BLOCK_MIN_SIZE || *block_size > BLOCK_MAX_SIZE) return -1;
+
+    return 0;
+}
+
+/* Stores the header in front of a block payload
+ */
+void block_write_header(unsigned char *out, int flags, size_t raw_len, size_t comp_len) {
+    out[0] = flags;
+    block_put32(out + 1, raw_len);
+    block_put32(out + 5, comp_len);
+}
+
+/* Reads the rest of a block header once its flags byte is known not to be
+ * BLOCK_END.
+ *
+ * Return: 0 on success, -1 if the flags are unknown
+ */
+int block_read_header(const unsigned char *in, int *flags, size_t *raw_len, size_t *comp_len) {
+    *flags = in[0];
+    *raw_len = block_get32(in + 1);
+    *comp_len = block_get32(in + 5);
+
+    if (*flags & ~(BLOCK_TABLE | BLOCK_RAW | BLOCK_STREAMS4 | BLOCK_STREAMS8 | BLOCK_CONTEXT)) return -1;
+    if ((*flags & BLOCK_CONTEXT) && (*flags & (BLOCK_TABLE | BLOCK_RAW))) return -1;
+    if ((*flags & BLOCK_STREAMS4) && (*flags & (BLOCK_STREAMS8 | BLOCK_RAW))) return -1;
+    if ((*flags & BLOCK_STREAMS8) && (*flags & BLOCK_RAW)) return -1;
+
+    return 0;
+}
+
+/* Prepares an encoder for the first block of an archive
+ *
+ * enc: zeroed or previously initialised, its memory is reused and released
+ *      with block_encoder_free
+ * num_streams: 1, or 4 or 8 to split the bitstream of each coded block
+ * mode: BLOCK_STATIC, or BLOCK_ADAPTIVE to code every block with one tree
+ *       grown over the archive, ignoring max_len and num_streams, or
+ *       BLOCK_ORDER1 to also try coding each block order-1
+ */
+void block_encoder_init(block_encoder_t *enc, int max_len, int num_streams, int mode) {
+    encode_pairs_t pairs = enc->job.pairs;
+    block_context_t *context = enc->job.context;
+
+    memset(enc, 0, sizeof(block_encoder_t));
+    enc->job.pairs = pairs;
+    enc->job.context = context;
+    enc->max_len = max_len;
+    enc->num_streams = num_streams;
+    enc->mode = mode;
+    if (mode == BLOCK_ADAPTIVE) adaptive_init(&enc->adaptive);
+}
+
+/* Releases the memory held by an encoder
+ */
+void block_encoder_free(block_encoder_t *enc) {
+    block_job_free(&enc->job);
+}
+
+/* Releases the memory held by a job
+ */
+void block_job_free(block_job_t *job) {
+    encode_pairs_free(&job->pairs);
+    free(job->context);
+    job->context = NULL;
+}
+
+// number of substreams the flags of a block call for
+int block_streams(int flags) {
+    if (flags & BLOCK_STREAMS8) return 8;
+    if (flags & BLOCK_STREAMS4) return 4;
+    return 1;
+}
+
+/* Returns the substreams the encoder splits a coded block of len bytes into
+ */
+int block_split(const block_encoder_t *enc, size_t len) {
+    return len >= BLOCK_MIN_SIZE ? enc->num_streams : 1;
+}
+
+// first symbol of a substream, stream num_streams gives the end of the block
+size_t substream_start(size_t len, int num_streams, int stream) {
+    size_t per_stream = (len + num_streams - 1) / num_streams;
+
+    return (size_t)stream * per_stream < len ? (size_t)stream * per_stream : len;
+}
+
+/******************************************************************************
+block_compress:
+Purpose:      Codes one block of input
+Parameters:   enc - encoder, carries the last table sent between blocks
+              in, len - bytes of the block (at most BLOCK_MAX_SIZE)
+              out - buffer of at least block_bound(len) bytes
+Return:       number of bytes stored, header included, 0 if out of memory
+Notes:        runs block_analyze, block_choose and block_encode in turn;
+              callers coding blocks in parallel run them separately.
+              Blocks of an adaptive archive go to block_compress_adaptive
+******************************************************************************/
+size_t block_compress(block_encoder_t *enc, const unsigned char *in, size_t len, unsigned char *out) {
+    if (enc->mode == BLOCK_ADAPTIVE) return block_compress_adaptive(enc, in, len, out);
+
+    if (block_analyze(&enc->job, enc, in, len) != 0) return 0;
+    block_choose(enc, &enc->job);
+    return block_encode(&enc->job, in, len, out);
+}
+
+/******************************************************************************
+block_compress_adaptive:
+Purpose:      Codes one block of an adaptive archive
+Parameters:   enc - encoder, carries the tree between blocks
+              in, len - bytes of the block
+              out - buffer of at least block_bound(len) bytes
+Return:       number of bytes stored, header included
+Notes:        the block is stored raw if coding would not make it smaller;
+              the tree is then rewound and only counts the bytes, as the
+              decoder does
+******************************************************************************/
+size_t block_compress_adaptive(block_encoder_t *enc, const unsigned char *in, size_t len, unsigned char *out) {
+    adaptive_t saved;
+    size_t comp_len;
+
+    enc->num_blocks++;
+
+    STATS_BEGIN(STATS_ENCODE);
+    memcpy(&saved, &enc->adaptive, sizeof(adaptive_t));
+    if (len > 0 && adaptive_encode(&enc->adaptive, in, len, out + BLOCK_HEADER, len - 1, &comp_len) == 0) {
+        block_write_header(out, 0, len, comp_len);
+    } else {
+        memcpy(&enc->adaptive, &saved, sizeof(adaptive_t));
+        adaptive_update(&enc->adaptive, in, len);
+        block_write_header(out, BLOCK_RAW, len, len);
+        memcpy(out + BLOCK_HEADER, in, len);
+        comp_len = len;
+        enc->num_raw++;
+    }
+    STATS_END(len);
+
+    return BLOCK_HEADER + comp_len;
+}
+
+/******************************************************************************
+block_analyze:
+Purpose:      Counts the symbols of a block and builds its own code table
+Parameters:   job - per-block state
+              enc - encoder, only its settings are read; in BLOCK_ORDER1
+                    mode the order-1 tables are built too
+              in, len - bytes of the block
+Return:       0 on success, -1 if out of memory
+Notes:        depends only on the block itself
+******************************************************************************/
+int block_analyze(block_job_t *job, const block_encoder_t *enc, const unsigned char *in, size_t len) {
+    // tally frequency of each symbol into a flat histogram
+    hist_reset(&job->hist);
+    hist_update(&job->hist, in, len);
+
+    if (block_build_table(job, enc->max_len) != 0) return -1;
+    if (enc->mode == BLOCK_ORDER1) block_build_context(job, enc->max_len, block_split(enc, len), in, len);
+    return 0;
+}
+
+/* Builds a block's own code table from the histogram in job->hist
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int block_build_table(block_job_t *job, int max_len) {
+    if (build_table_codes(job, job->hist.count, job->hist.total, max_len, job->codes, &job->limit_cost) != 0)
+        return -1;
+    job->table_len = codes_store_lengths(job->codes, job->table);
+    return 0;
+}
+
+/******************************************************************************
+block_build_context:
+Purpose:      Builds the order-1 tables of a block and what coding with
+              them costs
+Parameters:   job - per-block state after block_build_table, job->context
+                    is allocated on first use
+              max_len - code length limit
+              num_streams - substreams the block is split into, from
+                            block_split
+              in, len - bytes of the block
+Return:       void
+Notes:        job->context->bits is left at UINT64_MAX if a sample of the
+              block shows little order-1 structure or one table looks as
+              good, and job->context NULL if out of memory, so the block
+              is coded order-0
+******************************************************************************/
+void block_build_context(block_job_t *job, int max_len, int num_streams, const unsigned char *in, size_t len) {
+    block_context_t *ctx = job->context;
+    uint64_t limit_cost;
+    int num_tables, k, c;
+
+    if (ctx == NULL && (ctx = job->context = (block_context_t *)calloc(1, sizeof(block_context_t))) == NULL) return;
+    ctx->bits = UINT64_MAX;
+
+    // too short to pay for a second table
+    if (len < 2 * CONTEXT_MIN_TABLE_SYMS) return;
+
+    // a sampled estimate first, blocks that stay order-0 skip the full count
+    STATS_BEGIN(STATS_CONTEXT);
+    if (context_probe(&ctx->model, job->hist.count, in, len) < CONTEXT_MIN_GAIN) {
+        STATS_END(len);
+        return;
+    }
+
+    // group contexts with like statistics, one table per group
+    context_count(&ctx->model, in, len, substream_start(len, num_streams, 1));
+    num_tables = context_cluster(&ctx->model, job->hist.count, len);
+    STATS_END(len);
+    if (num_tables == 0) return;
+
+    ctx->header_len = context_store_map(&ctx->model, ctx->header);
+    ctx->bits = 0;
+    ctx->limit_cost = 0;
+
+    ctx->max_len = 0;
+
+    for (k = 0; k < num_tables; k++) {
+        if (build_table_codes(job, ctx->model.hist[k], len, max_len, ctx->codes[k], &limit_cost) != 0) {
+            ctx->bits = UINT64_MAX;
+            return;
+        }
+        for (c = 0; c < NUM_SYMS; c++) {
+            if (ctx->codes[k][c].code_len > ctx->max_len) ctx->max_len = ctx->codes[k][c].code_len;
+        }
+        ctx->header_len += codes_store_lengths(ctx->codes[k], ctx->header + ctx->header_len);
+        ctx->bits += codes_cost(ctx->codes[k], ctx->model.hist[k]);
+        ctx->limit_cost += limit_cost;
+    }
+    ctx->bits += 8 * (uint64_t)ctx->header_len;
+
+    for (c = 0; c < NUM_SYMS; c++) ctx->table_of[c] = ctx->codes[ctx->model.map[c]];
+}
+
+/* Builds a code table for symbol counts, total being their sum
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int build_table_codes(block_job_t *job, const uint64_t *count, uint64_t total, int max_len, huffman_codes_t *codes,
+                      uint64_t *limit_cost) {
+    list_t *L;
+
+    // list the symbols present with their frequencies
+    STATS_BEGIN(STATS_CALC_FREQ);
+    list_arena_init(&job->arena, job->list_buf, sizeof(job->list_buf));
+    if ((L = list_construct_arena(compare, compare_freq, &job->arena)) == NULL) {
+        STATS_END(0);
+        return -1;
+    }
+    calc_freq(count, L);
+    STATS_END(total);
+
+    // sort list, build varying length bit patterns from sorted symbols
+    STATS_BEGIN(STATS_LIST_SORT);
+    list_sort(L);
+    STATS_END(total);
+    build_codes(L, codes, max_len, limit_cost);
+    list_arena_reset(&job->arena);
+    return 0;
+}
+
+/******************************************************************************
+block_choose:
+Purpose:      Picks how an analyzed block is coded
+Parameters:   enc - encoder, carries the last table sent between blocks
+              job - per-block state from block_analyze, job->codes is set
+                    to the table the block is coded with
+Return:       void
+Notes:        the block reuses the last table sent if that codes it in no
+              more bits than a new table plus its own codes, and is stored
+              raw if coding would not make it smaller; blocks must be
+              chosen in order. Blocks shorter than BLOCK_MIN_SIZE are
+              never split into substreams. In BLOCK_ORDER1 mode the block
+              is coded order-1 if that takes fewer bits than any of these,
+              leaving the last table sent as it was
+******************************************************************************/
+void block_choose(block_encoder_t *enc, block_job_t *job) {
+    uint64_t new_bits, reuse_bits = UINT64_MAX, raw_bits = 8 * job->hist.total, split_bits = 0;
+    uint64_t context_bits = UINT64_MAX;
+    int i, streams = 0, num_streams = block_split(enc, job->hist.total);
+
+    // jump table plus at most one byte of padding per substream
+    if (num_streams > 1) {
+        streams = num_streams == 8 ? BLOCK_STREAMS8 : BLOCK_STREAMS4;
+        split_bits = 8 * (4 * (num_streams - 1) + num_streams);
+    }
+
+    new_bits = codes_cost(job->codes, job->hist.count) + 8 * job->table_len + split_bits;
+
+    // last table can only be reused if it has a code for every symbol
+    if (enc->have_codes) {
+        reuse_bits = codes_cost(enc->codes, job->hist.count) + split_bits;
+        for (i = 0; i < NUM_SYMS; i++) {
+            if (job->hist.count[i] != 0 && enc->codes[i].code_len == 0) reuse_bits = UINT64_MAX;
+        }
+    }
+
+    if (enc->mode == BLOCK_ORDER1 && job->context != NULL && job->context->bits != UINT64_MAX)
+        context_bits = job->context->bits + split_bits;
+
+    enc->num_blocks++;
+
+    if (context_bits < new_bits && context_bits < reuse_bits && context_bits < raw_bits) {
+        job->flags = BLOCK_CONTEXT | streams;
+        enc->limit_cost += job->context->limit_cost;
+        enc->num_context++;
+    } else if (reuse_bits <= new_bits && reuse_bits < raw_bits) {
+        job->flags = streams;
+        memcpy(job->codes, enc->codes, sizeof(enc->codes));
+        enc->num_reused++;
+    } else if (new_bits < raw_bits) {
+        job->flags = BLOCK_TABLE | streams;
+        memcpy(enc->codes, job->codes, sizeof(enc->codes));
+        enc->have_codes = 1;
+        enc->limit_cost += job->limit_cost;
+    } else {
+        // coding would not save anything
+        job->flags = BLOCK_RAW;
+        enc->num_raw++;
+    }
+}
+
+/******************************************************************************
+block_encode:
+Purpose:      Stores a block as chosen by block_choose
+Parameters:   job - per-block state
+              in, len - bytes of the block
+              out - buffer of at least block_bound(len) bytes
+Return:       number of bytes stored, header included
+Notes:        blocks of ENCODE_PAIR_MIN_SYMS or more whose codes are at most
+              ENCODE_PAIR_MAX_LEN bits are coded two symbols per lookup
+              from a pair table, which a job keeps for the next block
+******************************************************************************/
+size_t block_encode(block_job_t *job, const unsigned char *in, size_t len, unsigned char *out) {
+    unsigned char *payload = out + BLOCK_HEADER, *jump;
+    int s, num_streams = block_streams(job->flags), use_pairs;
+    size_t start, end;
+    bit_writer_t bw;
+
+    if (job->flags & BLOCK_RAW) {
+        memcpy(payload, in, len);
+        block_write_header(out, BLOCK_RAW, len, len);
+        return BLOCK_HEADER + len;
+    }
+
+    if (job->flags & BLOCK_CONTEXT) {
+        memcpy(payload, job->context->header, job->context->header_len);
+        payload += job->context->header_len;
+    } else if (job->flags & BLOCK_TABLE) {
+        memcpy(payload, job->table, job->table_len);
+        payload += job->table_len;
+    }
+
+    // output varying bit length patterns, one bitstream per substream
+    STATS_BEGIN(STATS_ENCODE);
+    use_pairs = !(job->flags & BLOCK_CONTEXT) && len >= ENCODE_PAIR_MIN_SYMS &&
+                encode_pairs_build(&job->pairs, job->codes) == 0;
+    jump = payload;
+    bit_writer_init(&bw, payload + 4 * (num_streams - 1));
+
+    for (s = 0; s < num_streams; s++) {
+        start = substream_start(len, num_streams, s);
+        end = substream_start(len, num_streams, s + 1);
+        payload = bw.ptr;
+        if (job->flags & BLOCK_CONTEXT)
+            encode_symbols_context(job->context->table_of, job->context->max_len, &bw, in + start, end - start);
+        else if (use_pairs)
+            encode_pairs_symbols(&job->pairs, &bw, in + start, end - start);
+        else
+            encode_symbols(job->codes, &bw, in + start, end - start);
+        bit_writer_flush(&bw);
+        if (s < num_streams - 1) block_put32(jump + 4 * s, bw.ptr - payload);
+    }
+    STATS_END(len);
+
+    block_write_header(out, job->flags, len, bw.ptr - out - BLOCK_HEADER);
+    return bw.ptr - out;
+}
+
+/* Prepares an empty index for blocks following the file header
+ */
+void block_index_init(block_index_t *idx) {
+    memset(idx, 0, sizeof(block_index_t));
+    idx->end_offset = BLOCK_FILE_HEADER;
+}
+
+/* Empties an index for the next archive, keeping its memory
+ */
+void block_index_reset(block_index_t *idx) {
+    idx->num_blocks = 0;
+    idx->end_offset = BLOCK_FILE_HEADER;
+    idx->raw_len = 0;
+    idx->last_table = 0;
+}
+
+void block_index_free(block_index_t *idx) {
+    free(idx->entry);
+    idx->entry = NULL;
+    idx->num_blocks = idx->max_blocks = 0;
+}
+
+/******************************************************************************
+block_index_add:
+Purpose:      Records the next block written to an archive
+Parameters:   idx - index of the blocks written so far
+              block - the block as stored, header first
+Return:       0 on success, -1 if out of memory
+******************************************************************************/
+int block_index_add(block_index_t *idx, const unsigned char *block) {
+    block_index_entry_t *e;
+    size_t raw_len, comp_len;
+    int flags;
+
+    if (idx->num_blocks == idx->max_blocks) {
+        uint64_t new_max = idx->max_blocks ? 2 * idx->max_blocks : 64;
+        if (new_max > (size_t)-1 / sizeof(block_index_entry_t)) return -1;
+        e = (block_index_entry_t *)realloc(idx->entry, new_max * sizeof(block_index_entry_t));
+        if (e == NULL) return -1;
+        idx->entry = e;
+        idx->max_blocks = new_max;
+    }
+
+    block_read_header(block, &flags, &raw_len, &comp_len);
+    if (flags & BLOCK_TABLE) idx->last_table = idx->end_offset;
+
+    e = &idx->entry[idx->num_blocks++];
+    e->offset = idx->end_offset;
+    e->table_offset = flags & (BLOCK_TABLE | BLOCK_RAW | BLOCK_CONTEXT) ? idx->end_offset : idx->last_table;
+    e->raw_offset = idx->raw_len;
+    e->raw_len = raw_len;
+
+    idx->end_offset += BLOCK_HEADER + comp_len;
+    idx->raw_len += raw_len;
+    return 0;
+}
+
+/* Returns the bytes block_index_store writes, footer included
+ */
+size_t block_index_size(const block_index_t *idx) {
+    return (size_t)idx->num_blocks * BLOCK_INDEX_ENTRY + BLOCK_FOOTER;
+}
+
+/* Stores the index and its footer, to be written right after the end marker
+ */
+void block_index_store(const block_index_t *idx, unsigned char *out) {
+    uint64_t i;
+
+    for (i = 0; i < idx->num_blocks; i++, out += BLOCK_INDEX_ENTRY) {
+        block_put64(out, idx->entry[i].offset);
+        block_put64(out + 8, idx->entry[i].table_offset);
+        block_put32(out + 16, idx->entry[i].raw_len);
+    }
+
+    // index starts after the end marker
+    block_put64(out, idx->end_offset + 1);
+    block_put64(out + 8, idx->num_blocks);
+    memcpy(out + 16, BLOCK_INDEX_MAGIC, 4);
+}
+
+/* Reads the footer in the last BLOCK_FOOTER bytes of an archive
+ *
+ * Return: 0 on success, -1 if the archive has no index
+ */
+int block_read_footer(const unsigned char *in, uint64_t *index_offset, uint64_t *num_blocks) {
+    if (memcmp(in + 16, BLOCK_INDEX_MAGIC, 4) != 0) return -1;
+
+    *index_offset = block_get64(in);
+    *num_blocks = block_get64(in + 8);
+    return 0;
+}
+
+/******************************************************************************
+block_index_load:
+Purpose:      Reads the index entries of an archive
+Parameters:   idx - index to fill, empty from block_index_init or
+                    block_index_reset
+              in - the num_blocks stored entries
+              num_blocks - count from the footer
+              block_size - block size from the file header
+Return:       0 on success, -1 if the index is malformed or out of memory
+******************************************************************************/
+int block_index_load(block_index_t *idx, const unsigned char *in, uint64_t num_blocks, size_t block_size) {
+    block_index_entry_t *e;
+    uint64_t i;
+
+    if (num_blocks > idx->max_blocks) {
+        if (num_blocks > (size_t)-1 / sizeof(block_index_entry_t)) return -1;
+        e = (block_index_entry_t *)realloc(idx->entry, num_blocks * sizeof(block_index_entry_t));
+        if (e == NULL) return -1;
+        idx->entry = e;
+        idx->max_blocks = num_blocks;
+    }
+
+    for (i = 0; i < num_blocks; i++, in += BLOCK_INDEX_ENTRY) {
+        e = &idx->entry[i];
+        e->offset = block_get64(in);
+        e->table_offset = block_get64(in + 8);
+        e->raw_len = block_get32(in + 16);
+        e->raw_offset = idx->raw_len;
+
+        // blocks follow each other and a table comes before its use
+        if (e->offset < idx->end_offset || e->table_offset > e->offset || e->raw_len > block_size) return -1;
+
+        idx->end_offset = e->offset + BLOCK_HEADER;
+        idx->raw_len += e->raw_len;
+        idx->num_blocks++;
+    }
+
+    return 0;
+}
+
+/* Prepares a decoder for the first block of an archive
+ */
+void block_decoder_init(block_decoder_t *dec) {
+    memset(dec, 0, sizeof(block_decoder_t));
+}
+
+/* Readies a decoder for the first block of an archive in the given mode,
+ * keeping the memory of its lookup tables
+ */
+void block_decoder_start(block_decoder_t *dec, int mode) {
+    dec->have_table = 0;
+    dec->mode = mode;
+    if (mode == BLOCK_ADAPTIVE) adaptive_init(&dec->adaptive);
+}
+
+/* Releases the lookup tables held by a decoder
+ */
+void block_decoder_free(block_decoder_t *dec) {
+    decode_table_free(&dec->table);
+    decode_context_free(&dec->context);
+    dec->have_table = 0;
+}
+
+/******************************************************************************
+block_load_table:
+Purpose:      Reads a code length table and builds its lookup tables
+Parameters:   dec - decoder, its table is replaced
+              in, len - payload of a block with BLOCK_TABLE set
+Return:       bytes of table read, -1 if the table is malformed
+******************************************************************************/
+int block_load_table(block_decoder_t *dec, const unsigned char *in, size_t len) {
+    int table_len;
+
+    // lookup tables are rebuilt in the memory of the previous ones
+    dec->have_table = 0;
+
+    // read code length table, rebuild canonical codes and lookup tables
+    STATS_BEGIN(STATS_READ_TABLE);
+    table_len = codes_read_lengths(dec->codes, in, len < CODES_MAX_HEADER ? len : CODES_MAX_HEADER);
+    if (table_len < 0 || codes_assign_canonical(dec->codes) != 0 || decode_table_build(&dec->table, dec->codes) != 0) {
+        STATS_END(0);
+        return -1;
+    }
+    STATS_END(table_len);
+
+    dec->have_table = 1;
+    return table_len;
+}
+
+/******************************************************************************
+block_load_context:
+Purpose:      Reads the context map and code length tables of a
+              BLOCK_CONTEXT block and builds its order-1 lookup tables
+Parameters:   dec - decoder, its order-1 tables are replaced, the last
+                    table received is left alone
+              in, len - payload of the block
+Return:       bytes of map and tables read, -1 if they are malformed
+******************************************************************************/
+int block_load_context(block_decoder_t *dec, const unsigned char *in, size_t len) {
+    huffman_codes_t codes[CONTEXT_MAX_TABLES][NUM_SYMS];
+    unsigned char map[NUM_SYMS];
+    size_t pos;
+    int num_tables, table_len, k;
+
+    STATS_BEGIN(STATS_READ_TABLE);
+    if ((num_tables = context_read_map(map, in, len)) < 0) {
+        STATS_END(0);
+        return -1;
+    }
+
+    for (k = 0, pos = CONTEXT_MAP_HEADER; k < num_tables; k++, pos += table_len) {
+        table_len = codes_read_lengths(codes[k], in + pos, len - pos < CODES_MAX_HEADER ? len - pos : CODES_MAX_HEADER);
+        if (table_len < 0 || codes_assign_canonical(codes[k]) != 0) {
+            STATS_END(0);
+            return -1;
+        }
+    }
+
+    if (decode_context_build(&dec->context, (const huffman_codes_t (*)[NUM_SYMS])codes, num_tables, map) != 0) {
+        STATS_END(0);
+        return -1;
+    }
+    STATS_END(pos);
+
+    return pos;
+}
+
+/******************************************************************************
+block_decompress:
+Purpose:      Decodes the payload of one block
+Parameters:   dec - decoder, carries the last table received, or the tree
+                    of an adaptive archive, between blocks
+              flags - flags from the block header
+              in, comp_len - payload of the block
+              out, raw_len - buffer for the decoded bytes
+Return:       0 on success, -1 if the block is malformed
+******************************************************************************/
+int block_decompress(block_decoder_t *dec, int flags, const unsigned char *in, size_t comp_len,
+                     unsigned char *out, size_t raw_len) {
+    int table_len = 0;
+
+    if (dec->mode == BLOCK_ADAPTIVE && (flags & ~BLOCK_RAW)) return -1;
+
+    if (flags & BLOCK_RAW) {
+        if (comp_len != raw_len) return -1;
+        memcpy(out, in, raw_len);
+        if (dec->mode == BLOCK_ADAPTIVE) adaptive_update(&dec->adaptive, out, raw_len);
+        return 0;
+    }
+
+    if (dec->mode == BLOCK_ADAPTIVE) {
+        STATS_BEGIN(STATS_DECODE);
+        if (adaptive_decode(&dec->adaptive, in, comp_len, out, raw_len) != 0) {
+            STATS_END(0);
+            return -1;
+        }
+        STATS_END(raw_len);
+        return 0;
+    }
+
+    if (flags & BLOCK_CONTEXT) {
+        if ((table_len = block_load_context(dec, in, comp_len)) < 0) return -1;
+    } else if (flags & BLOCK_TABLE) {
+        if ((table_len = block_load_table(dec, in, comp_len)) < 0) return -1;
+    } else if (!dec->have_table) {
+        return -1;
+    }
+
+    return block_decode(dec, flags, in + table_len, comp_len - table_len, out, raw_len);
+}
+
+/******************************************************************************
+block_decode:
+Purpose:      Decodes the bitstream of a coded block whose tables are loaded
+Parameters:   dec - decoder holding the last table received, or the
+                    order-1 tables for a BLOCK_CONTEXT block
+              flags - flags from the block header
+              in, len - payload of the block after its tables
+              out, raw_len - buffer for the decoded bytes
+Return:       0 on success, -1 if the jump table does not fit the payload
+******************************************************************************/
+int block_decode(const block_decoder_t *dec, int flags, const unsigned char *in, size_t len,
+                 unsigned char *out, size_t raw_len) {
+    bit_reader_t br;
+
+    // decode varying bit patterns
+    STATS_BEGIN(STATS_DECODE);
+    if (flags & (BLOCK_STREAMS4 | BLOCK_STREAMS8)) {
+        if (read_substreams(dec, flags, in, len, out, raw_len) != 0) {
+            STATS_END(0);
+            return -1;
+        }
+    } else {
+        bit_reader_init(&br, in, len);
+        if (flags & BLOCK_CONTEXT)
+            decode_symbols_context(&dec->context, &br, out, raw_len, 0);
+        else
+            decode_symbols(&dec->table, &br, out, raw_len, 1);
+    }
+    STATS_END(raw_len);
+    return 0;
+}
+
+/******************************************************************************
+read_substreams:
+Purpose:      Decodes a bitstream split into substreams
+Parameters:   dec - decoder holding the lookup tables for the block's code,
+                    order-1 ones for a BLOCK_CONTEXT block
+              flags - flags from the block header, giving 4 or 8 streams
+              in, len - jump table followed by the substreams
+              out, raw_len - buffer for the decoded bytes
+Return:       0 on success, -1 if the jump table does not fit the payload
+Notes:        substreams are stepped four at a time with decode_symbols_x4
+              or decode_symbols_context_x4, the last few symbols of each are
+              finished one stream at a time
+******************************************************************************/
+int read_substreams(const block_decoder_t *dec, int flags, const unsigned char *in, size_t len,
+                   unsigned char *out, size_t raw_len) {
+    bit_reader_t br[BLOCK_MAX_STREAMS];
+    unsigned char *dst[BLOCK_MAX_STREAMS], *start;
+    size_t count[BLOCK_MAX_STREAMS], stream_len, pos;
+    int s, g, num_streams = block_streams(flags);
+
+    if (len < 4 * (size_t)(num_streams - 1)) return -1;
+    pos = 4 * (num_streams - 1);
+
+    for (s = 0; s < num_streams; s++) {
+        stream_len = s < num_streams - 1 ? block_get32(in + 4 * s) : len - pos;
+        if (stream_len > len - pos) return -1;
+
+        bit_reader_init(&br[s], in + pos, stream_len);
+        dst[s] = out + substream_start(raw_len, num_streams, s);
+        count[s] = substream_start(raw_len, num_streams, s + 1) - substream_start(raw_len, num_streams, s);
+        pos += stream_len;
+    }
+
+    for (g = 0; g < num_streams; g += 4) {
+        if (!(flags & BLOCK_CONTEXT)) {
+            decode_symbols_x4(&dec->table, br + g, dst + g, count + g);
+            for (s = g; s < g + 4; s++) decode_symbols(&dec->table, &br[s], dst[s], count[s], 1);
+            continue;
+        }
+
+        // each order-1 stream carries on from the last byte it decoded
+        decode_symbols_context_x4(&dec->context, br + g, dst + g, count + g);
+        for (s = g; s < g + 4; s++) {
+            start = out + substream_start(raw_len, num_streams, s);
+            decode_symbols_context(&dec->context, &br[s], dst[s], count[s], dst[s] > start ? dst[s][-1] : 0);
+        }
+    }
+
+    return 0;
+}
+
+// list the symbols present in a histogram with their frequencies
+void calc_freq(const uint64_t *count, list_t *list) {
+    int i;
+
+    // add each symbol present to list
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (count[i] == 0) continue;
+        data_t tmp_data = { .sym = i, .freq = count[i] };
+        list_insert_copy(list, &tmp_data, NULL);
+    }
+}
+
+// determine the Huffman code for each symbol in a list sorted by frequency,
+// limited to max_len bits; limit_cost receives the bits the limit adds
+void build_codes(list_t *list, huffman_codes_t *huff_codes, int max_len, uint64_t *limit_cost) {
+    unsigned char sym[NUM_SYMS];
+    uint64_t sorted_freq[NUM_SYMS], freq[NUM_SYMS] = {0};
+    uint64_t tree_cost, total = 0;
+    list_node_t *rover;
+    data_t *data;
+    int n = 0, longest;
+
+    memset(huff_codes, 0, NUM_SYMS * sizeof(huffman_codes_t));
+    *limit_cost = 0;
+
+    // copy sorted symbols into flat arrays for the tree construction
+    for (rover = list_iter_front(list); rover != NULL; rover = list_iter_next(rover)) {
+        data = list_access(list, rover);
+        sym[n] = data->sym;
+        sorted_freq[n++] = data->freq;
+        freq[data->sym] = data->freq;
+        total += data->freq;
+    }
+
+    STATS_BEGIN(STATS_BUILD_TREE);
+    longest = codes_build_lengths(huff_codes, sym, sorted_freq, n);
+    STATS_END(total);
+
+    // tree too deep, find the best lengths within the limit instead
+    STATS_BEGIN(STATS_BUILD_CODES);
+    if (longest > max_len) {
+        tree_cost = codes_cost(huff_codes, freq);
+        codes_limit_lengths(huff_codes, freq, max_len);
+        *limit_cost = codes_cost(huff_codes, freq) - tree_cost;
+    }
+
+    // only the lengths come from the tree, codes are canonical
+    codes_assign_canonical(huff_codes);
+    STATS_END(total);
+}
+
+// comparison function for linked list
+int compare(const data_t *a, const data_t *b) {
+    if (a->sym < b->sym)
+        return 1;
+    else if (a->sym > b->sym)
+        return -1;
+    else
+        return 0;
+}
+
+// comparison function for linked list sorting algorithms
+int compare_freq(const data_t *a, const data_t *b) {
+    if (a->freq < b->freq)
+        return 1;
+    else if (a->freq > b->freq)
+        return -1;
+    else { // sort ties by alphabetical order
+        if (a->sym < b->sym)
+            return 1;
+        else if (a->sym > b->sym)
+            return -1;
+        else
+            return 0;
+    }
+}
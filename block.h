@@ -0,0 +1,190 @@
+//
+//  block.h
+//  API for the block-based .huf container
+//  input is split into independently coded blocks, each with its own table
+//
+//  file:   "HUF" version (1 byte) block_size (4 bytes)  block ... end index
+//  block:  flags (1 byte) raw_len (4 bytes) comp_len (4 bytes) payload
+//  end:    BLOCK_END (1 byte)
+//  index:  entry ... index_offset (8 bytes) num_blocks (8 bytes) "HUFI"
+//  entry:  block offset (8 bytes) table offset (8 bytes) raw_len (4 bytes)
+//
+//  payload is the code length table (if BLOCK_TABLE) followed by the
+//  bitstream, or the bytes themselves for BLOCK_RAW; a block without
+//  either flag reuses the last table sent
+//
+//  with BLOCK_STREAMS4 or BLOCK_STREAMS8 the block is cut into 4 or 8 equal
+//  runs of symbols (the last one shorter), each coded as its own bitstream;
+//  a jump table of the byte lengths of all but the last stream (4 bytes
+//  each) comes before the streams so they can be decoded side by side
+//
+//  per-block lengths fit in 4 bytes since a block is at most BLOCK_MAX_SIZE;
+//  every file-wide offset, length and count is 8 bytes
+//
+//  the index gives the file offset of every block and of the block holding
+//  its table, so blocks can be decoded out of order; sequential readers
+//  stop at the end marker and never look at it
+//
+//  a BLOCK_CONTEXT payload carries its own tables and is coded order-1:
+//  a context map (see context.h) then the code length table of each of its
+//  tables, then one bitstream in which each symbol is coded with the table
+//  the map gives the byte before it, the first symbol as if after a 0. It
+//  neither uses nor replaces the last table sent. Split into substreams,
+//  each substream starts as if after a 0
+//
+//  an archive with version BLOCK_VERSION_ADAPTIVE has no tables: its blocks
+//  are coded with one adaptive Huffman tree that both ends grow as they go,
+//  so every block depends on all before it and is decoded in order. Its
+//  blocks are coded (no flags) or BLOCK_RAW, and still counted into the tree
+//
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stddef.h>
+#include "hist.h"
+#include "codes.h"
+#include "decode.h"
+#include "encode.h"
+#include "list.h"
+#include "adaptive.h"
+#include "context.h"
+
+#define BLOCK_MAGIC "HUF"
+#define BLOCK_VERSION 2             // archive of blocks with their own tables
+#define BLOCK_VERSION_ADAPTIVE 3    // archive coded with one adaptive tree
+#define BLOCK_FILE_HEADER 8         // bytes in file header
+#define BLOCK_HEADER 9              // bytes in block header
+
+#define BLOCK_INDEX_MAGIC "HUFI"
+#define BLOCK_INDEX_ENTRY 20        // bytes per index entry
+#define BLOCK_FOOTER 20             // bytes in index footer
+
+#define BLOCK_MAX_STREAMS 8         // substreams per block
+
+#define BLOCK_DEFAULT_SIZE (1 << 20)
+#define BLOCK_MIN_SIZE (1 << 12)
+#define BLOCK_MAX_SIZE (1 << 26)
+
+// archive modes
+#define BLOCK_STATIC 0              // per-block code tables
+#define BLOCK_ADAPTIVE 1            // one adaptive tree for the whole archive
+#define BLOCK_ORDER1 2              // per-block tables, or tables picked by the byte before
+
+// block flags
+#define BLOCK_TABLE 0x01            // payload starts with a new code length table
+#define BLOCK_RAW 0x02              // payload is stored uncoded
+#define BLOCK_STREAMS4 0x04         // bitstream split into 4 substreams
+#define BLOCK_STREAMS8 0x08         // bitstream split into 8 substreams
+#define BLOCK_CONTEXT 0x10          // payload is coded order-1 with its own tables
+#define BLOCK_END 0x80              // no more blocks
+
+// order-1 coding of a block, in BLOCK_ORDER1 mode only
+typedef struct block_context_tag {
+    context_model_t model;
+    huffman_codes_t codes[CONTEXT_MAX_TABLES][NUM_SYMS];
+    const huffman_codes_t *table_of[NUM_SYMS];  // table of each context
+    unsigned char header[CONTEXT_MAP_HEADER + CONTEXT_MAX_TABLES * CODES_MAX_HEADER];   // map and tables
+    int header_len;
+    int max_len;                        // longest code of any table
+    uint64_t bits;                      // payload bits, UINT64_MAX if not worth it
+    uint64_t limit_cost;                // bits added by the code length limit
+} block_context_t;
+
+// state of one block between analysis and encoding
+typedef struct block_job_tag {
+    hist_t hist;
+    huffman_codes_t codes[NUM_SYMS];    // table the block is coded with
+    unsigned char table[CODES_MAX_HEADER];  // stored code lengths of its own table
+    int table_len;
+    uint64_t limit_cost;                // bits added by the code length limit
+    int flags;
+    encode_pairs_t pairs;               // two-symbol codes for large blocks
+    block_context_t *context;           // allocated on the first block of BLOCK_ORDER1 mode
+    // symbol list memory, reused by every block the job codes
+    list_arena_t arena;
+    uint64_t list_buf[(sizeof(list_t) + NUM_SYMS * sizeof(list_node_t) + 7) / 8];
+} block_job_t;
+
+typedef struct block_encoder_tag {
+    int max_len;                        // code length limit
+    int num_streams;                    // substreams per coded block, 1, 4 or 8
+    int mode;                           // BLOCK_STATIC, BLOCK_ADAPTIVE or BLOCK_ORDER1
+    huffman_codes_t codes[NUM_SYMS];    // last table sent
+    int have_codes;
+    block_job_t job;                    // scratch for block_compress
+    adaptive_t adaptive;                // tree of an adaptive archive
+    // statistics
+    uint64_t limit_cost;                // bits added by the code length limit
+    uint64_t num_blocks;
+    uint64_t num_reused;                // blocks reusing the previous table
+    uint64_t num_raw;                   // blocks stored uncoded
+    uint64_t num_context;               // blocks coded order-1
+} block_encoder_t;
+
+typedef struct block_index_entry_tag {
+    uint64_t offset;                    // file offset of block header
+    uint64_t table_offset;              // file offset of block holding its table
+    uint64_t raw_offset;                // offset of its bytes in the original file
+    uint32_t raw_len;
+} block_index_entry_t;
+
+typedef struct block_index_tag {
+    block_index_entry_t *entry;
+    uint64_t num_blocks;
+    uint64_t max_blocks;
+    uint64_t end_offset;                // file offset just past the last block
+    uint64_t raw_len;                   // bytes in the original file
+    uint64_t last_table;                // offset of the last block with a table
+} block_index_t;
+
+typedef struct block_decoder_tag {
+    huffman_codes_t codes[NUM_SYMS];    // last table received
+    decode_table_t table;
+    int have_table;
+    int mode;                           // BLOCK_STATIC or BLOCK_ADAPTIVE
+    adaptive_t adaptive;                // tree of an adaptive archive
+    decode_context_t context;           // tables of the last BLOCK_CONTEXT block
+} block_decoder_t;
+
+// public prototype definitions for block.c
+size_t block_bound(size_t raw_len);
+void block_put32(unsigned char *out, uint32_t val);
+uint32_t block_get32(const unsigned char *in);
+void block_put64(unsigned char *out, uint64_t val);
+uint64_t block_get64(const unsigned char *in);
+void block_write_file_header(unsigned char *out, size_t block_size, int mode);
+int block_read_file_header(const unsigned char *in, size_t *block_size, int *mode);
+void block_write_header(unsigned char *out, int flags, size_t raw_len, size_t comp_len);
+int block_read_header(const unsigned char *in, int *flags, size_t *raw_len, size_t *comp_len);
+
+void block_encoder_init(block_encoder_t *enc, int max_len, int num_streams, int mode);
+void block_encoder_free(block_encoder_t *enc);
+void block_job_free(block_job_t *job);
+size_t block_compress(block_encoder_t *enc, const unsigned char *in, size_t len, unsigned char *out);
+int block_analyze(block_job_t *job, const block_encoder_t *enc, const unsigned char *in, size_t len);
+int block_build_table(block_job_t *job, int max_len);
+void block_build_context(block_job_t *job, int max_len, int num_streams, const unsigned char *in, size_t len);
+int block_split(const block_encoder_t *enc, size_t len);
+void block_choose(block_encoder_t *enc, block_job_t *job);
+size_t block_encode(block_job_t *job, const unsigned char *in, size_t len, unsigned char *out);
+void block_index_init(block_index_t *idx);
+void block_index_reset(block_index_t *idx);
+void block_index_free(block_index_t *idx);
+int block_index_add(block_index_t *idx, const unsigned char *block);
+size_t block_index_size(const block_index_t *idx);
+void block_index_store(const block_index_t *idx, unsigned char *out);
+int block_read_footer(const unsigned char *in, uint64_t *index_offset, uint64_t *num_blocks);
+int block_index_load(block_index_t *idx, const unsigned char *in, uint64_t num_blocks, size_t block_size);
+
+void block_decoder_init(block_decoder_t *dec);
+void block_decoder_start(block_decoder_t *dec, int mode);
+void block_decoder_free(block_decoder_t *dec);
+int block_load_table(block_decoder_t *dec, const unsigned char *in, size_t len);
+int block_load_context(block_decoder_t *dec, const unsigned char *in, size_t len);
+int block_decompress(block_decoder_t *dec, int flags, const unsigned char *in, size_t comp_len,
+                     unsigned char *out, size_t raw_len);
+int block_decode(const block_decoder_t *dec, int flags, const unsigned char *in, size_t len,
+                 unsigned char *out, size_t raw_len);
+
+#endif
@@ -0,0 +1,284 @@
+//
+//  codes.c
+//  Canonical Huffman code assignment and code length tables
+//  codes are derived from code lengths alone, so only lengths are stored
+//
+
+#include "codes.h"
+
+// run flag for a stored code length, the next byte holds the run length - 2
+#define CODES_RUN 0x80
+#define CODES_LEN_MASK 0x7f
+
+/******************************************************************************
+codes_assign_canonical:
+Purpose:      Assigns canonical codes from the code length of each symbol
+Parameters:   codes - code table with code_len set, code is filled in
+Return:       0 on success, -1 if the lengths do not form a prefix code
+Notes:        shorter codes come first and codes of equal length are in
+              symbol order, so the decoder rebuilds the same codes from the
+              lengths without a tree
+******************************************************************************/
+int codes_assign_canonical(huffman_codes_t *codes) {
+    int len_count[CODES_MAX_LEN + 1] = {0};
+    uint64_t next_code[CODES_MAX_LEN + 1];
+    uint64_t code = 0;
+    int i, len;
+
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len < 0 || codes[i].code_len > CODES_MAX_LEN) return -1;
+        len_count[codes[i].code_len]++;
+    }
+
+    // first code of each length follows the last code of the length before
+    len_count[0] = 0;
+    for (len = 1; len <= CODES_MAX_LEN; len++) {
+        code = (code + len_count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+
+    for (i = 0; i < NUM_SYMS; i++) {
+        len = codes[i].code_len;
+        if (len == 0) continue;
+
+        codes[i].code = next_code[len]++;
+        // more codes of this length than the length can hold
+        if (codes[i].code >> len != 0) return -1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+codes_build_lengths:
+Purpose:      Computes Huffman code lengths for symbols sorted by frequency
+Parameters:   codes - code table, code_len is set for the given symbols
+              sym - symbols in ascending order of frequency
+              freq - frequency of each of those symbols
+              n - number of symbols
+Return:       length of the longest code
+Notes:        two-queue construction done in place on a flat array
+              (Moffat & Katajainen), linear time and no allocation; the
+              sorted leaves form one queue and the merged nodes the other
+******************************************************************************/
+int codes_build_lengths(huffman_codes_t *codes, const unsigned char *sym, const uint64_t *freq, int n) {
+    uint64_t A[NUM_SYMS];
+    int root, leaf, next, avbl, used, depth;
+
+    if (n == 0) return 0;
+    if (n == 1) {
+        // a lone symbol still needs one bit per occurrence
+        codes[sym[0]].code_len = 1;
+        return 1;
+    }
+
+    // first pass, left to right, merge the two lightest nodes and leave
+    // a parent pointer in place of each merged node
+    A[0] = freq[0] + freq[1];
+    for (next = 2; next < n; next++) A[next] = freq[next];
+
+    root = 0;
+    leaf = 2;
+    for (next = 1; next < n - 1; next++) {
+        if (leaf >= n || A[root] < A[leaf]) {
+            A[next] = A[root];
+            A[root++] = next;
+        } else {
+            A[next] = A[leaf++];
+        }
+
+        if (leaf >= n || (root < next && A[root] < A[leaf])) {
+            A[next] += A[root];
+            A[root++] = next;
+        } else {
+            A[next] += A[leaf++];
+        }
+    }
+
+    // second pass, right to left, turn parent pointers into depths
+    A[n - 2] = 0;
+    for (next = n - 3; next >= 0; next--) A[next] = A[A[next]] + 1;
+
+    // third pass, right to left, hand out leaf depths level by level
+    avbl = 1;
+    used = depth = 0;
+    root = n - 2;
+    next = n - 1;
+    while (avbl > 0) {
+        while (root >= 0 && A[root] == depth) {
+            used++;
+            root--;
+        }
+
+        while (avbl > used) {
+            A[next--] = depth;
+            avbl--;
+        }
+
+        avbl = 2 * used;
+        depth++;
+        used = 0;
+    }
+
+    // lightest symbol has the longest code
+    for (next = 0; next < n; next++) codes[sym[next]].code_len = A[next];
+
+    return A[0];
+}
+
+/******************************************************************************
+codes_limit_lengths:
+Purpose:      Finds the optimal code lengths no longer than a given limit
+Parameters:   codes - code table, code_len is replaced
+              freq - frequency of each symbol, 0 for absent symbols
+              max_len - longest code length allowed
+Return:       0 on success, -1 if max_len cannot hold every symbol
+Notes:        package-merge: each level merges the symbols with pairs of
+              items from the level below, the cheapest 2n - 2 items of the
+              top level decide how often each symbol is counted
+******************************************************************************/
+int codes_limit_lengths(huffman_codes_t *codes, const uint64_t *freq, int max_len) {
+    short item[CODES_MAX_LEN][2 * NUM_SYMS];    // symbol of each item, -1 for packages
+    int num_items[CODES_MAX_LEN];
+    uint64_t weight[2][2 * NUM_SYMS];
+    unsigned char leaf[NUM_SYMS];
+    int i, j, k, n = 0, lvl, packages, leaves;
+    uint64_t *prev, *cur;
+
+    if (max_len < 1 || max_len > CODES_MAX_LEN) return -1;
+
+    // symbols present in ascending order of frequency, ties by symbol
+    for (i = 0; i < NUM_SYMS; i++) {
+        codes[i].code_len = 0;
+        if (freq[i] == 0) continue;
+
+        for (j = n; j > 0 && freq[leaf[j - 1]] > freq[i]; j--) leaf[j] = leaf[j - 1];
+
+        leaf[j] = i;
+        n++;
+    }
+
+    if (n == 0) return 0;
+    if (n == 1) {
+        codes[leaf[0]].code_len = 1;
+        return 0;
+    }
+    if (max_len < 9 && n > 1 << max_len) return -1;
+
+    // deepest level holds only the symbols
+    for (i = 0; i < n; i++) {
+        item[0][i] = leaf[i];
+        weight[0][i] = freq[leaf[i]];
+    }
+    num_items[0] = n;
+
+    // every level above merges the symbols with packages of the level below
+    for (lvl = 1; lvl < max_len; lvl++) {
+        prev = weight[(lvl - 1) & 1];
+        cur = weight[lvl & 1];
+        packages = num_items[lvl - 1] / 2;
+        i = j = k = 0;
+
+        while (i < n || j < packages) {
+            if (j >= packages || (i < n && freq[leaf[i]] <= prev[2 * j] + prev[2 * j + 1])) {
+                item[lvl][k] = leaf[i];
+                cur[k++] = freq[leaf[i++]];
+            } else {
+                item[lvl][k] = -1;
+                cur[k++] = prev[2 * j] + prev[2 * j + 1];
+                j++;
+            }
+        }
+
+        num_items[lvl] = k;
+    }
+
+    // select the cheapest items, each package selects its two items below
+    k = 2 * n - 2;
+    for (lvl = max_len - 1; lvl >= 0 && k > 0; lvl--) {
+        leaves = 0;
+
+        for (i = 0; i < k; i++) {
+            if (item[lvl][i] >= 0) {
+                codes[item[lvl][i]].code_len++;
+                leaves++;
+            }
+        }
+
+        k = 2 * (k - leaves);
+    }
+
+    return 0;
+}
+
+/* Returns the number of bits needed to code the given symbol frequencies
+ */
+uint64_t codes_cost(const huffman_codes_t *codes, const uint64_t *freq) {
+    uint64_t bits = 0;
+    int i;
+
+    for (i = 0; i < NUM_SYMS; i++)
+        bits += freq[i] * codes[i].code_len;
+
+    return bits;
+}
+
+/******************************************************************************
+codes_store_lengths:
+Purpose:      Run-length codes the code length of every symbol
+Parameters:   codes - code table
+              out - buffer of at least CODES_MAX_HEADER bytes
+Return:       number of bytes stored
+Notes:        a lone length takes one byte, a run of equal lengths takes the
+              length with CODES_RUN set and a byte holding the run - 2
+******************************************************************************/
+int codes_store_lengths(const huffman_codes_t *codes, unsigned char *out) {
+    int i = 0, run, n = 0;
+
+    while (i < NUM_SYMS) {
+        for (run = 1; i + run < NUM_SYMS && codes[i + run].code_len == codes[i].code_len; run++);
+
+        if (run == 1) {
+            out[n++] = codes[i].code_len;
+        } else {
+            out[n++] = CODES_RUN | codes[i].code_len;
+            out[n++] = run - 2;
+        }
+
+        i += run;
+    }
+
+    return n;
+}
+
+/******************************************************************************
+codes_read_lengths:
+Purpose:      Reads a table stored by codes_store_lengths
+Parameters:   codes - code table, code_len is filled in and code is cleared
+              in, len - stored table
+Return:       number of bytes read, -1 if the table is malformed
+******************************************************************************/
+int codes_read_lengths(huffman_codes_t *codes, const unsigned char *in, int len) {
+    int i = 0, j, run, n = 0;
+
+    while (i < NUM_SYMS) {
+        if (n >= len) return -1;
+
+        run = 1;
+        if (in[n] & CODES_RUN) {
+            if (n + 1 >= len) return -1;
+            run = in[n + 1] + 2;
+        }
+
+        if (i + run > NUM_SYMS || (in[n] & CODES_LEN_MASK) > CODES_MAX_LEN) return -1;
+
+        for (j = 0; j < run; j++, i++) {
+            codes[i].code = 0;
+            codes[i].code_len = in[n] & CODES_LEN_MASK;
+        }
+
+        n += in[n] & CODES_RUN ? 2 : 1;
+    }
+
+    return n;
+}
@@ -0,0 +1,31 @@
+//
+//  codes.h
+//  Huffman code table shared by the encoder and decoder
+//  canonical code assignment and code length tables
+//
+
+#ifndef CODES_H
+#define CODES_H
+
+#include <stdint.h>
+
+#define NUM_SYMS 256
+#define CODES_MAX_LEN 56          // longest code length a table may hold
+#define CODES_DEFAULT_LIMIT 12    // default code length limit, matches the decoder's primary table
+#define CODES_MAX_HEADER (2 * NUM_SYMS)   // largest stored code length table
+
+// code table entry, indexed by symbol
+typedef struct huffman_codes_tag {
+    uint64_t code;      // code bits, right aligned
+    int code_len;       // number of bits in code, 0 for absent symbols
+} huffman_codes_t;
+
+// public prototype definitions for codes.c
+int codes_build_lengths(huffman_codes_t *codes, const unsigned char *sym, const uint64_t *freq, int n);
+int codes_assign_canonical(huffman_codes_t *codes);
+int codes_limit_lengths(huffman_codes_t *codes, const uint64_t *freq, int max_len);
+uint64_t codes_cost(const huffman_codes_t *codes, const uint64_t *freq);
+int codes_store_lengths(const huffman_codes_t *codes, unsigned char *out);
+int codes_read_lengths(huffman_codes_t *codes, const unsigned char *in, int len);
+
+#endif
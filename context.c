@@ -0,0 +1,377 @@
+//
+//  context.c
+//  API for order-1 context modelling
+//  groups the contexts of a block, named by the byte before each symbol,
+//  into a few clusters that share a code table
+//
+
+#include <string.h>
+#include "context.h"
+
+// costs are in 1/65536 bits
+#define CONTEXT_ONE_BIT ((uint64_t)1 << 16)
+// bits a sampled histogram underestimates per symbol seen, 1 / (2 ln 2)
+#define CONTEXT_SAMPLE_BIAS 47274
+
+// prototypes for private functions used in context.c only
+uint64_t context_log2(uint64_t);
+uint64_t context_cost(const uint64_t *, int *);
+uint64_t context_table_cost(int);
+void context_assign(context_model_t *, const int *, int, int);
+int context_merge(context_model_t *, uint64_t *, int);
+
+/******************************************************************************
+context_probe:
+Purpose:      Estimates cheaply what order-1 coding could save on a block
+Parameters:   ctx - model, its sample counts are overwritten
+              order0 - counts of the whole block
+              in, len - bytes of the block
+Return:       estimated saving in 1/1000 of the order-0 bits, 0 if the byte
+              before tells nothing
+Notes:        counts CONTEXT_SAMPLE_RUNS runs spread over the block, the 31
+              busiest bytes as contexts of their own and the rest as one,
+              about as many contexts as a block gets tables. Each histogram
+              is charged the bits a sample of its size misses, so data with
+              no order-1 structure reads near 0 however many symbols it uses
+******************************************************************************/
+int context_probe(context_model_t *ctx, const uint64_t *order0, const unsigned char *in, size_t len) {
+    uint64_t sample0[NUM_SYMS] = {0}, order0_cost, order1_cost = 0;
+    unsigned char slot[NUM_SYMS];
+    size_t start, end, i;
+    unsigned int prev;
+    int r, c, s, best, present;
+
+    // busiest bytes first, a pick of the largest count each time
+    memset(slot, CONTEXT_SAMPLE_CONTEXTS - 1, sizeof(slot));
+    for (r = 0; r < CONTEXT_SAMPLE_CONTEXTS - 1; r++) {
+        for (s = 0, best = -1; s < NUM_SYMS; s++) {
+            if (slot[s] == CONTEXT_SAMPLE_CONTEXTS - 1 && order0[s] != 0 && (best < 0 || order0[s] > order0[best]))
+                best = s;
+        }
+        if (best < 0) break;
+        slot[best] = r;
+    }
+
+    memset(ctx->sample, 0, sizeof(ctx->sample));
+    for (r = 0; r < CONTEXT_SAMPLE_RUNS; r++) {
+        start = len / CONTEXT_SAMPLE_RUNS * r;
+        end = len - start < CONTEXT_SAMPLE_LEN ? len : start + CONTEXT_SAMPLE_LEN;
+        prev = start ? in[start - 1] : 0;
+
+        for (i = start; i < end; i++) {
+            ctx->sample[slot[prev]][in[i]]++;
+            sample0[in[i]]++;
+            prev = in[i];
+        }
+    }
+
+    order0_cost = context_cost(sample0, &present);
+    if (present < 2) return 0;
+    order0_cost += (present - 1) * CONTEXT_SAMPLE_BIAS;
+
+    for (c = 0; c < CONTEXT_SAMPLE_CONTEXTS; c++) {
+        order1_cost += context_cost(ctx->sample[c], &present);
+        if (present > 1) order1_cost += (present - 1) * CONTEXT_SAMPLE_BIAS;
+    }
+
+    if (order1_cost >= order0_cost) return 0;
+    return (order0_cost - order1_cost) * 1000 / order0_cost;
+}
+
+/* Counts the symbols of a block by the byte before each; the block is coded
+ * in runs of stream_len symbols, the first of each following a 0
+ */
+void context_count(context_model_t *ctx, const unsigned char *in, size_t len, size_t stream_len) {
+    unsigned int prev = 0;
+    size_t i, next = stream_len;
+    int c, s;
+
+    // only the rows the last block used need clearing
+    for (c = 0; c < NUM_SYMS; c++) {
+        if (ctx->total[c] == 0) continue;
+        memset(ctx->count[c], 0, sizeof(ctx->count[c]));
+        ctx->total[c] = 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (i == next) {
+            prev = 0;
+            next += stream_len;
+        }
+        ctx->count[prev][in[i]]++;
+        prev = in[i];
+    }
+
+    // row totals afterwards, keeping the loop to one increment per symbol
+    for (c = 0; c < NUM_SYMS; c++) {
+        for (s = 0; s < NUM_SYMS; s++) ctx->total[c] += ctx->count[c][s];
+    }
+}
+
+/******************************************************************************
+context_cluster:
+Purpose:      Groups the contexts counted by context_count into clusters
+              that each get a code table
+Parameters:   ctx - model holding the counts, receives the map and the
+                    symbol counts of each cluster
+              order0 - counts of the whole block
+              len - symbols in the block
+Return:       number of tables, 0 if one table for the whole block looks
+              as good once the map and tables are paid for
+Notes:        the busiest contexts seed the clusters; each pass moves every
+              context to the cluster whose statistics code it in the fewest
+              bits, then clusters are merged while that saves more table
+              than it costs in codes. Costs are entropy estimates, the
+              caller makes the final choice with real code lengths
+******************************************************************************/
+int context_cluster(context_model_t *ctx, const uint64_t *order0, size_t len) {
+    uint64_t cost[CONTEXT_MAX_TABLES], order0_cost, order1_cost, n, total;
+    int active[NUM_SYMS], num_active = 0, num_tables, order0_present, present, pass, c, i, j, s, k;
+
+    // contexts seen, each with the symbols seen in it; the rest keep table 0
+    memset(ctx->map, 0, sizeof(ctx->map));
+    for (c = 0; c < NUM_SYMS; c++) {
+        if (ctx->total[c] == 0) continue;
+        active[num_active++] = c;
+
+        for (s = 0, k = 0; s < NUM_SYMS; s++) {
+            if (ctx->count[c][s] != 0) ctx->present[c][k++] = s;
+        }
+        ctx->num_present[c] = k;
+    }
+
+    num_tables = len / CONTEXT_MIN_TABLE_SYMS;
+    if (num_tables > CONTEXT_MAX_TABLES) num_tables = CONTEXT_MAX_TABLES;
+    if (num_tables > num_active) num_tables = num_active;
+    if (num_tables < 2) return 0;
+
+    // even a table per context cannot win back the map
+    order0_cost = context_cost(order0, &order0_present);
+    order1_cost = 0;
+    for (i = 0; i < num_active; i++) {
+        c = active[i];
+        total = ctx->total[c];
+        order1_cost += total * context_log2(total);
+        for (j = 0; j < ctx->num_present[c]; j++) {
+            n = ctx->count[c][ctx->present[c][j]];
+            order1_cost -= n * context_log2(n);
+        }
+    }
+    if (order1_cost + 8 * CONTEXT_MAP_HEADER * CONTEXT_ONE_BIT >= order0_cost) return 0;
+
+    // busiest contexts first, each seeds a cluster of its own
+    for (i = 1; i < num_active; i++) {
+        for (j = i, c = active[i]; j > 0 && ctx->total[active[j - 1]] < ctx->total[c]; j--) {
+            active[j] = active[j - 1];
+        }
+        active[j] = c;
+    }
+
+    memset(ctx->hist, 0, sizeof(ctx->hist));
+    for (k = 0; k < num_tables; k++) {
+        for (s = 0; s < NUM_SYMS; s++) ctx->hist[k][s] = ctx->count[active[k]][s];
+    }
+
+    for (pass = 0; pass < CONTEXT_PASSES; pass++) context_assign(ctx, active, num_active, num_tables);
+
+    // drop clusters left empty
+    for (k = 0, j = 0; k < num_tables; k++) {
+        cost[j] = context_cost(ctx->hist[k], &present);
+        if (present == 0) continue;
+
+        if (j != k) {
+            memcpy(ctx->hist[j], ctx->hist[k], sizeof(ctx->hist[k]));
+            for (i = 0; i < num_active; i++) {
+                if (ctx->map[active[i]] == k) ctx->map[active[i]] = j;
+            }
+        }
+        cost[j++] += context_table_cost(present);
+    }
+    num_tables = context_merge(ctx, cost, j);
+
+    // map and tables against one table for the block
+    for (k = 0, total = 8 * CONTEXT_MAP_HEADER * CONTEXT_ONE_BIT; k < num_tables; k++) total += cost[k];
+    if (num_tables < 2 || total >= order0_cost + context_table_cost(order0_present)) return 0;
+
+    ctx->num_tables = num_tables;
+    return num_tables;
+}
+
+/* Stores the number of tables and the table of each context
+ *
+ * Return: bytes stored, CONTEXT_MAP_HEADER
+ */
+int context_store_map(const context_model_t *ctx, unsigned char *out) {
+    int c;
+
+    out[0] = ctx->num_tables;
+    for (c = 0; c < NUM_SYMS; c += 2) out[1 + c / 2] = ctx->map[c] | ctx->map[c + 1] << 4;
+
+    return CONTEXT_MAP_HEADER;
+}
+
+/* Reads a map stored by context_store_map
+ *
+ * Return: number of tables, -1 if the map is malformed
+ */
+int context_read_map(unsigned char *map, const unsigned char *in, size_t len) {
+    int c, num_tables;
+
+    if (len < CONTEXT_MAP_HEADER) return -1;
+
+    num_tables = in[0];
+    if (num_tables < 1 || num_tables > CONTEXT_MAX_TABLES) return -1;
+
+    for (c = 0; c < NUM_SYMS; c += 2) {
+        map[c] = in[1 + c / 2] & 0x0f;
+        map[c + 1] = in[1 + c / 2] >> 4;
+        if (map[c] >= num_tables || map[c + 1] >= num_tables) return -1;
+    }
+
+    return num_tables;
+}
+
+/******************************************************************************
+context_assign:
+Purpose:      Moves every context to the cluster that codes it cheapest
+Parameters:   ctx - model, its map and cluster counts are updated
+              active, num_active - contexts seen
+              num_tables - clusters
+Return:       void
+Notes:        a symbol a cluster has not seen is priced one bit above its
+              rarest possible one; clusters are recounted from the new map
+******************************************************************************/
+void context_assign(context_model_t *ctx, const int *active, int num_active, int num_tables) {
+    uint32_t bits[CONTEXT_MAX_TABLES][NUM_SYMS];
+    uint64_t total, cost, best_cost;
+    int i, j, k, c, s, best;
+
+    for (k = 0; k < num_tables; k++) {
+        for (s = 0, total = 0; s < NUM_SYMS; s++) total += ctx->hist[k][s];
+        for (s = 0; s < NUM_SYMS; s++) {
+            bits[k][s] = ctx->hist[k][s] ? context_log2(total) - context_log2(ctx->hist[k][s])
+                                         : context_log2(total) + CONTEXT_ONE_BIT;
+        }
+    }
+
+    for (i = 0; i < num_active; i++) {
+        c = active[i];
+        best = 0;
+        best_cost = UINT64_MAX;
+
+        for (k = 0; k < num_tables; k++) {
+            for (j = 0, cost = 0; j < ctx->num_present[c]; j++) {
+                s = ctx->present[c][j];
+                cost += (uint64_t)ctx->count[c][s] * bits[k][s];
+            }
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = k;
+            }
+        }
+
+        ctx->map[c] = best;
+    }
+
+    memset(ctx->hist, 0, sizeof(ctx->hist));
+    for (i = 0; i < num_active; i++) {
+        c = active[i];
+        for (j = 0; j < ctx->num_present[c]; j++) {
+            s = ctx->present[c][j];
+            ctx->hist[ctx->map[c]][s] += ctx->count[c][s];
+        }
+    }
+}
+
+/******************************************************************************
+context_merge:
+Purpose:      Merges clusters pairwise while a merge lowers the total cost
+Parameters:   ctx - model, its map and cluster counts are updated
+              cost - estimated bits of each cluster, its codes and table
+              num_tables - clusters
+Return:       number of clusters left
+Notes:        each round merges the pair that gains the most; small blocks
+              end up with few tables as their tables cost relatively more
+******************************************************************************/
+int context_merge(context_model_t *ctx, uint64_t *cost, int num_tables) {
+    uint64_t merged[NUM_SYMS], merged_cost, best_cost = 0, gain, best_gain;
+    int a, b, s, c, present, best_a = 0, best_b = 0;
+
+    while (num_tables > 1) {
+        best_gain = 0;
+
+        for (a = 0; a < num_tables; a++) {
+            for (b = a + 1; b < num_tables; b++) {
+                for (s = 0; s < NUM_SYMS; s++) merged[s] = ctx->hist[a][s] + ctx->hist[b][s];
+                merged_cost = context_cost(merged, &present) + context_table_cost(present);
+
+                gain = cost[a] + cost[b] > merged_cost ? cost[a] + cost[b] - merged_cost : 0;
+                if (gain > best_gain) {
+                    best_gain = gain;
+                    best_cost = merged_cost;
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+
+        if (best_gain == 0) break;
+
+        // b joins a, the last cluster takes the place of b
+        for (s = 0; s < NUM_SYMS; s++) ctx->hist[best_a][s] += ctx->hist[best_b][s];
+        cost[best_a] = best_cost;
+        num_tables--;
+
+        for (c = 0; c < NUM_SYMS; c++) {
+            if (ctx->map[c] == best_b)
+                ctx->map[c] = best_a;
+            else if (ctx->map[c] == num_tables)
+                ctx->map[c] = best_b;
+        }
+        memcpy(ctx->hist[best_b], ctx->hist[num_tables], sizeof(ctx->hist[best_b]));
+        cost[best_b] = cost[num_tables];
+    }
+
+    return num_tables;
+}
+
+/* Returns the entropy of a histogram times its count, the bits an ideal
+ * code spends on it, and the number of symbols in it
+ */
+uint64_t context_cost(const uint64_t *hist, int *present) {
+    uint64_t total = 0, cost = 0;
+    int s;
+
+    *present = 0;
+    for (s = 0; s < NUM_SYMS; s++) {
+        if (hist[s] == 0) continue;
+        total += hist[s];
+        cost -= hist[s] * context_log2(hist[s]);
+        (*present)++;
+    }
+
+    return cost + total * context_log2(total);
+}
+
+// rough size of a stored code length table with this many symbols
+uint64_t context_table_cost(int present) {
+    return 8 * (uint64_t)(present + 2) * CONTEXT_ONE_BIT;
+}
+
+/* Returns log2 of x in 1/65536 bits, to within about 0.001 bits, using
+ * integer arithmetic only
+ */
+uint64_t context_log2(uint64_t x) {
+    uint64_t f, t;
+    int e;
+
+    if (x == 0) return 0;
+
+    // x = 2^e * (1 + f), f in 16 fraction bits
+    e = 63 - __builtin_clzll(x);
+    f = (e >= 16 ? x >> (e - 16) : x << (16 - e)) - CONTEXT_ONE_BIT;
+
+    // log2(1 + f) ~ f + f (1 - f) (0.423 - 0.159 f)
+    t = f * (CONTEXT_ONE_BIT - f) >> 16;
+    return ((uint64_t)e << 16) + f + (t * (27722 - (10420 * f >> 16)) >> 16);
+}
@@ -0,0 +1,48 @@
+//
+//  context.h
+//  API for order-1 context modelling
+//  groups the contexts of a block, named by the byte before each symbol,
+//  into a few clusters that share a code table
+//
+//  stored map: num_tables (1 byte) then the table of each context, two
+//  contexts per byte, the even one in the low 4 bits
+//
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "codes.h"
+#include "decode.h"
+
+#define CONTEXT_MAX_TABLES DECODE_CONTEXT_TABLES    // code tables per block, a table number fits 4 bits
+#define CONTEXT_MAP_HEADER (1 + NUM_SYMS / 2)   // bytes in a stored map
+#define CONTEXT_MIN_TABLE_SYMS (1 << 14)        // symbols a block needs per table, each a build for the decoder
+#define CONTEXT_PASSES 4                        // rounds of moving contexts between clusters
+#define CONTEXT_SAMPLE_RUNS 32                  // runs of a block context_probe counts
+#define CONTEXT_SAMPLE_LEN 1024                 // symbols in each run
+#define CONTEXT_SAMPLE_CONTEXTS 32              // coarse contexts, the busiest bytes each then the rest
+#define CONTEXT_MIN_GAIN 20                     // saving, in 1/1000 of the order-0 bits, context_probe must see
+
+typedef struct context_model_tag {
+    uint32_t count[NUM_SYMS][NUM_SYMS];         // symbol counts, indexed by context then symbol
+    uint32_t total[NUM_SYMS];                   // symbols counted in each context
+    uint64_t hist[CONTEXT_MAX_TABLES][NUM_SYMS];    // symbol counts of each cluster
+    unsigned char map[NUM_SYMS];                // cluster of each context
+    int num_tables;
+    // scratch for context_probe
+    uint64_t sample[CONTEXT_SAMPLE_CONTEXTS][NUM_SYMS];
+    // scratch for context_cluster
+    unsigned char present[NUM_SYMS][NUM_SYMS];  // symbols seen in each context
+    int num_present[NUM_SYMS];
+} context_model_t;
+
+// public prototype definitions for context.c
+int context_probe(context_model_t *ctx, const uint64_t *order0, const unsigned char *in, size_t len);
+void context_count(context_model_t *ctx, const unsigned char *in, size_t len, size_t stream_len);
+int context_cluster(context_model_t *ctx, const uint64_t *order0, size_t len);
+int context_store_map(const context_model_t *ctx, unsigned char *out);
+int context_read_map(unsigned char *map, const unsigned char *in, size_t len);
+
+#endif
@@ -0,0 +1,52 @@
+//
+//  cpu.c
+//  API for runtime detection of instruction set extensions
+//  kernels built for newer CPUs are picked once at run time, no separate builds
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+
+// detected extensions, -1 until the first call
+static int cpu_detected = -1;
+
+// prototypes for private functions used in cpu.c only
+int cpu_detect(void);
+
+/* Returns the CPU_ flags of the extensions the kernels may use
+ *
+ * The CPU is queried on the first call only. Setting HUFF_CPU to "scalar"
+ * or "bmi2" in the environment limits the kernels picked, which is how the
+ * fallbacks are checked against the fast paths.
+ */
+int cpu_features(void) {
+    int features = __atomic_load_n(&cpu_detected, __ATOMIC_RELAXED);
+
+    // threads racing here all store the same value
+    if (features < 0) {
+        features = cpu_detect();
+        __atomic_store_n(&cpu_detected, features, __ATOMIC_RELAXED);
+    }
+
+    return features;
+}
+
+// query cpuid, then apply any limit from the environment
+int cpu_detect(void) {
+    const char *limit = getenv("HUFF_CPU");
+    int features = 0;
+
+#ifdef CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("bmi2")) features |= CPU_BMI2;
+    if (__builtin_cpu_supports("avx2")) features |= CPU_AVX2;
+#endif
+
+    if (limit != NULL && strcmp(limit, "scalar") == 0)
+        features = 0;
+    else if (limit != NULL && strcmp(limit, "bmi2") == 0)
+        features &= CPU_BMI2;
+
+    return features;
+}
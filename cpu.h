@@ -0,0 +1,25 @@
+//
+//  cpu.h
+//  API for runtime detection of instruction set extensions
+//  kernels built for newer CPUs are picked once at run time, no separate builds
+//
+
+#ifndef CPU_H
+#define CPU_H
+
+// instruction set extensions the kernels can use
+#define CPU_BMI2 0x01             // shlx/shrx/bzhi for the bit buffers
+#define CPU_AVX2 0x02             // 256-bit integer vectors and gathers
+
+// kernels for an extension are compiled in on x86-64 with gcc or clang only
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CPU_X86 1
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+// public prototype definitions for cpu.c
+int cpu_features(void);
+
+#endif
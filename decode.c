@@ -0,0 +1,901 @@
+//
+//  decode.c
+//  API for table-driven Huffman decoding
+//  resolves a whole code per table lookup instead of one bit per tree step
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "decode.h"
+#include "stats.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+#define DECODE_INLINE static inline __attribute__((always_inline))
+
+// prototypes for private functions used in decode.c only
+int decode_table_grow(decode_table_t *, int);
+int decode_fill_level(decode_table_t *, int, int, int, uint64_t, const huffman_codes_t *);
+int decode_fill_multi(decode_table_t *, const huffman_codes_t *);
+// hot helpers are always inlined, so each build of a decode loop gets its own
+DECODE_INLINE void bit_reader_refill(bit_reader_t *);
+DECODE_INLINE unsigned char decode_next(const uint32_t *, bit_reader_t *);
+DECODE_INLINE size_t decode_kernel(const uint32_t *, bit_reader_t *, unsigned char *, size_t, int);
+DECODE_INLINE size_t decode_kernel_multi(const decode_table_t *, bit_reader_t *, unsigned char *, size_t, int);
+DECODE_INLINE size_t decode_kernel_x4(const uint32_t *, bit_reader_t *, unsigned char *const *, size_t);
+size_t decode_symbols_scalar(const uint32_t *, bit_reader_t *, unsigned char *, size_t, int);
+size_t decode_symbols_bmi2(const uint32_t *, bit_reader_t *, unsigned char *, size_t, int);
+size_t decode_multi_scalar(const decode_table_t *, bit_reader_t *, unsigned char *, size_t, int);
+size_t decode_multi_bmi2(const decode_table_t *, bit_reader_t *, unsigned char *, size_t, int);
+size_t decode_x4_scalar(const uint32_t *, bit_reader_t *, unsigned char *const *, size_t);
+size_t decode_x4_bmi2(const uint32_t *, bit_reader_t *, unsigned char *const *, size_t);
+size_t decode_x4_avx2(const uint32_t *, bit_reader_t *, unsigned char *const *, size_t);
+DECODE_INLINE void decode_step_multi(const decode_table_t *, bit_reader_t *, unsigned char **, size_t *);
+DECODE_INLINE void decode_kernel_multi_x4(const decode_table_t *, bit_reader_t *, unsigned char **, size_t *);
+DECODE_INLINE void decode_kernel_context(const decode_context_t *, bit_reader_t *, unsigned char *, size_t, int);
+DECODE_INLINE void decode_step_context(const decode_context_t *, bit_reader_t *, unsigned char **, size_t *, int *);
+DECODE_INLINE void decode_kernel_context_x4(const decode_context_t *, bit_reader_t *, unsigned char **, size_t *);
+void decode_context_scalar(const decode_context_t *, bit_reader_t *, unsigned char *, size_t, int);
+void decode_context_bmi2(const decode_context_t *, bit_reader_t *, unsigned char *, size_t, int);
+void decode_context_x4_scalar(const decode_context_t *, bit_reader_t *, unsigned char **, size_t *);
+void decode_context_x4_bmi2(const decode_context_t *, bit_reader_t *, unsigned char **, size_t *);
+void decode_x4_multi_scalar(const decode_table_t *, bit_reader_t *, unsigned char **, size_t *);
+void decode_x4_multi_bmi2(const decode_table_t *, bit_reader_t *, unsigned char **, size_t *);
+
+/******************************************************************************
+decode_table_build:
+Purpose:      Builds the lookup tables for a prefix code
+Parameters:   table - zeroed or previously built table, its memory is
+                      reused and released with decode_table_free
+              codes - code table indexed by symbol
+Return:       0 on success, -1 if a code is too long or memory runs out
+Notes:        codes longer than DECODE_TABLE_BITS continue in secondary
+              tables reached through link entries of the primary table;
+              a multi-symbol table is added when the code is short enough
+              on average for a lookup to cover more than one symbol
+******************************************************************************/
+int decode_table_build(decode_table_t *table, const huffman_codes_t *codes) {
+    int i;
+
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len > DECODE_MAX_CODE_LEN) return -1;
+    }
+
+    table->num_entries = 0;
+
+    table->use_multi = 0;
+
+    if (decode_table_grow(table, 1 << DECODE_TABLE_BITS) != 0) return -1;
+
+    if (decode_fill_level(table, 0, DECODE_TABLE_BITS, 0, 0, codes) != 0) return -1;
+
+    return decode_fill_multi(table, codes);
+}
+
+/* Releases the memory held by a decode table
+ */
+void decode_table_free(decode_table_t *table) {
+    free(table->entry);
+    free(table->multi);
+    table->entry = NULL;
+    table->multi = NULL;
+    table->use_multi = 0;
+    table->num_entries = 0;
+    table->max_entries = 0;
+}
+
+/******************************************************************************
+decode_table_grow:
+Purpose:      Appends zeroed entries to a decode table
+Parameters:   table - table to extend
+              count - number of entries to add
+Return:       offset of the first new entry, -1 if out of memory
+******************************************************************************/
+int decode_table_grow(decode_table_t *table, int count) {
+    int i, offset = table->num_entries;
+
+    if (offset + count > table->max_entries) {
+        int new_max = table->max_entries ? table->max_entries : 1 << DECODE_TABLE_BITS;
+        uint32_t *new_entry;
+
+        while (new_max < offset + count) new_max *= 2;
+
+        new_entry = (uint32_t *)realloc(table->entry, new_max * sizeof(uint32_t));
+        STATS_ALLOC();
+        if (new_entry == NULL) return -1;
+
+        table->entry = new_entry;
+        table->max_entries = new_max;
+    }
+
+    for (i = 0; i < count; i++) table->entry[offset + i] = 0;
+
+    table->num_entries += count;
+    return offset;
+}
+
+/******************************************************************************
+decode_fill_level:
+Purpose:      Fills one table level with the codes sharing a prefix
+Parameters:   table - table being built
+              base - offset of this level in table->entry
+              bits - index bits of this level
+              depth - code bits already resolved by the levels above
+              prefix - value of those resolved bits
+              codes - code table indexed by symbol
+Return:       0 on success, -1 if out of memory
+Notes:        recurses into a secondary table for every group of codes
+              that does not fit in the remaining bits of this level
+******************************************************************************/
+int decode_fill_level(decode_table_t *table, int base, int bits, int depth, uint64_t prefix,
+                      const huffman_codes_t *codes) {
+    int sub_bits[1 << DECODE_TABLE_BITS];
+    int i, j, rem, key, offset, sub, any_sub = 0;
+    uint64_t val;
+
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len <= depth) continue;
+        if (depth > 0 && codes[i].code >> (codes[i].code_len - depth) != prefix) continue;
+
+        rem = codes[i].code_len - depth;
+        val = codes[i].code & ((1ULL << rem) - 1);
+
+        // code ends in this level, fill every index starting with it
+        if (rem <= bits) {
+            key = val << (bits - rem);
+            for (j = 0; j < 1 << (bits - rem); j++)
+                table->entry[base + key + j] = (uint32_t)i << 8 | rem;
+        }
+        // code continues below, size the secondary table for its group
+        else {
+            // most codes fit the primary table, clear the sizes on first use
+            if (!any_sub) memset(sub_bits, 0, sizeof(int) << bits);
+            any_sub = 1;
+            key = val >> (rem - bits);
+            if (rem - bits > sub_bits[key]) sub_bits[key] = rem - bits;
+        }
+    }
+
+    for (key = 0; any_sub && key < 1 << bits; key++) {
+        if (sub_bits[key] == 0) continue;
+
+        sub = sub_bits[key] < DECODE_TABLE_BITS ? sub_bits[key] : DECODE_TABLE_BITS;
+        if ((offset = decode_table_grow(table, 1 << sub)) < 0) return -1;
+
+        table->entry[base + key] = (uint32_t)offset << 8 | DECODE_LINK | sub;
+        if (decode_fill_level(table, offset, sub, depth + bits, prefix << bits | key, codes) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+decode_fill_multi:
+Purpose:      Builds the multi-symbol table from a filled primary table
+Parameters:   table - table with its primary level built
+              codes - code table indexed by symbol
+Return:       0 on success, -1 if out of memory
+Notes:        skipped, leaving use_multi clear, when the average code length
+              the code implies (each code of length l taken to have
+              probability 2^-l) is over DECODE_MULTI_AVG_LEN bits; each
+              entry holds the whole codes at the front of its index, found
+              by looking up the rest of the index in the primary table
+******************************************************************************/
+int decode_fill_multi(decode_table_t *table, const huffman_codes_t *codes) {
+    const int mask = (1 << DECODE_TABLE_BITS) - 1;
+    uint64_t avg_len = 0;
+    int i, used, count, bits;
+    uint64_t syms;
+    uint32_t e;
+
+    // in units of 2^-32 bits, codes over 32 bits add next to nothing
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len > 0 && codes[i].code_len <= 32)
+            avg_len += (uint64_t)codes[i].code_len << (32 - codes[i].code_len);
+    }
+    if (avg_len > (uint64_t)DECODE_MULTI_AVG_LEN << 32) return 0;
+
+    if (table->multi == NULL) {
+        table->multi = (uint64_t *)malloc(sizeof(uint64_t) << DECODE_TABLE_BITS);
+        STATS_ALLOC();
+        if (table->multi == NULL) return -1;
+    }
+
+    for (i = 0; i <= mask; i++) {
+        syms = 0;
+        count = 0;
+        used = 0;
+
+        // a code counts only if all of its bits are inside the index
+        while (count < DECODE_MULTI_MAX) {
+            e = table->entry[(i << used) & mask];
+            bits = e & DECODE_BITS_MASK;
+            if ((e & DECODE_LINK) || bits > DECODE_TABLE_BITS - used) break;
+
+            syms |= (uint64_t)(e >> 8) << (8 * count);
+            count++;
+            used += bits;
+        }
+
+        table->multi[i] = (uint64_t)used << 40 | (uint64_t)count << 32 | syms;
+    }
+
+    table->use_multi = 1;
+    return 0;
+}
+
+/******************************************************************************
+decode_context_build:
+Purpose:      Builds the lookup tables for an order-1 code
+Parameters:   ctx - zeroed or previously built tables, their memory is
+                    reused and released with decode_context_free
+              codes - code table of each of num_tables tables
+              num_tables - 1 to DECODE_CONTEXT_TABLES
+              map - table picked by each byte, each below num_tables
+Return:       0 on success, -1 if a code is too long or memory runs out
+Notes:        every multi-symbol entry is filled whatever the code lengths,
+              as a lookup replaces a table switch as well as a symbol; an
+              entry follows its codes from table to table
+******************************************************************************/
+int decode_context_build(decode_context_t *ctx, const huffman_codes_t (*codes)[NUM_SYMS], int num_tables,
+                         const unsigned char *map) {
+    const int mask = (1 << DECODE_CONTEXT_BITS) - 1;
+    int i, k, t, used, count, bits;
+    uint64_t syms;
+    uint32_t e;
+
+    for (k = 0; k < num_tables; k++) {
+        for (i = 0; i < NUM_SYMS; i++) {
+            if (codes[k][i].code_len > DECODE_MAX_CODE_LEN) return -1;
+        }
+
+        ctx->table[k].num_entries = 0;
+        if (decode_table_grow(&ctx->table[k], 1 << DECODE_TABLE_BITS) != 0) return -1;
+        if (decode_fill_level(&ctx->table[k], 0, DECODE_TABLE_BITS, 0, 0, codes[k]) != 0) return -1;
+    }
+
+    if (ctx->multi == NULL) {
+        ctx->multi = (uint64_t *)malloc(sizeof(uint64_t) * DECODE_CONTEXT_TABLES << DECODE_CONTEXT_BITS);
+        STATS_ALLOC();
+        if (ctx->multi == NULL) return -1;
+    }
+
+    memcpy(ctx->map, map, NUM_SYMS);
+    ctx->num_tables = num_tables;
+
+    for (k = 0; k < num_tables; k++) {
+        for (i = 0; i <= mask; i++) {
+            syms = 0;
+            count = 0;
+            used = 0;
+
+            // as for decode_fill_multi, each code looked up in the table of
+            // the one before it
+            for (t = k; count < DECODE_MULTI_MAX; t = map[e >> 8]) {
+                e = ctx->table[t].entry[((i << used) & mask) << (DECODE_TABLE_BITS - DECODE_CONTEXT_BITS)];
+                bits = e & DECODE_BITS_MASK;
+                if ((e & DECODE_LINK) || bits > DECODE_CONTEXT_BITS - used) break;
+
+                syms |= (uint64_t)(e >> 8) << (8 * count);
+                count++;
+                used += bits;
+            }
+
+            ctx->multi[k << DECODE_CONTEXT_BITS | i] =
+                (uint64_t)t << 48 | (uint64_t)used << 40 | (uint64_t)count << 32 | syms;
+        }
+    }
+
+    return 0;
+}
+
+/* Releases the memory held by the tables of an order-1 code
+ */
+void decode_context_free(decode_context_t *ctx) {
+    int k;
+
+    for (k = 0; k < DECODE_CONTEXT_TABLES; k++) decode_table_free(&ctx->table[k]);
+    free(ctx->multi);
+    ctx->multi = NULL;
+    ctx->num_tables = 0;
+}
+
+/* Points a bit reader at the start of a buffer of coded bits
+ */
+void bit_reader_init(bit_reader_t *br, const unsigned char *buf, size_t len) {
+    br->ptr = buf;
+    br->end = buf + len;
+    br->bits = 0;
+    br->count = 0;
+}
+
+/* Tops up the bit buffer of a reader for callers outside this file
+ */
+void bit_reader_fill(bit_reader_t *br) {
+    bit_reader_refill(br);
+}
+
+/******************************************************************************
+bit_reader_refill:
+Purpose:      Tops up the bit buffer to at least 56 valid bits
+Parameters:   br - bit reader
+Return:       void
+Notes:        loads 8 bytes at once while they are available, past the end
+              of the input the buffer is filled with zero bits
+******************************************************************************/
+DECODE_INLINE void bit_reader_refill(bit_reader_t *br) {
+    uint64_t word;
+    int i;
+
+    if (br->end - br->ptr >= 8) {
+        word = 0;
+        for (i = 0; i < 8; i++) word = word << 8 | br->ptr[i];
+        br->bits |= word >> br->count;
+        br->ptr += (63 - br->count) >> 3;
+        br->count |= 56;
+    } else {
+        while (br->count <= 56) {
+            if (br->ptr < br->end) br->bits |= (uint64_t)*br->ptr++ << (56 - br->count);
+            br->count += 8;
+        }
+    }
+}
+
+/******************************************************************************
+decode_symbols:
+Purpose:      Decodes symbols from a bit reader into a buffer
+Parameters:   table - lookup tables for the prefix code
+              br - bit reader positioned at the next code
+              out - buffer for at least num_syms symbols
+              num_syms - number of symbols wanted
+              final - nonzero if the reader holds the end of the input
+Return:       number of symbols decoded
+Notes:        unless final, stops early once fewer than 8 bytes are left so
+              the caller can append more input behind br->ptr. Uses the
+              multi-symbol table when there is one, and runs the BMI2
+              build of the loop when the CPU has it
+******************************************************************************/
+size_t decode_symbols(const decode_table_t *table, bit_reader_t *br, unsigned char *out, size_t num_syms, int final) {
+#ifdef CPU_X86
+    if (cpu_features() & CPU_BMI2) {
+        if (table->use_multi) return decode_multi_bmi2(table, br, out, num_syms, final);
+        return decode_symbols_bmi2(table->entry, br, out, num_syms, final);
+    }
+#endif
+    if (table->use_multi) return decode_multi_scalar(table, br, out, num_syms, final);
+    return decode_symbols_scalar(table->entry, br, out, num_syms, final);
+}
+
+/******************************************************************************
+decode_symbols_x4:
+Purpose:      Decodes four independent bitstreams side by side
+Parameters:   table - lookup tables for the prefix code shared by the streams
+              br - four bit readers, one per stream
+              out - four output pointers, each advanced past the symbols
+                    decoded into it
+              num_syms - symbols wanted from each stream, each reduced by
+                         the symbols decoded from it
+Return:       void
+Notes:        each stream is its own chain of dependent lookups, so stepping
+              all four in one iteration lets them overlap; stops once any
+              reader has fewer than 8 bytes or any stream a few symbols
+              left, the caller finishes each stream with decode_symbols.
+              With a multi-symbol table the streams may each advance by a
+              different count; otherwise, with AVX2, the four bit buffers
+              share a vector and are refilled and looked up with gathers
+******************************************************************************/
+void decode_symbols_x4(const decode_table_t *table, bit_reader_t *br, unsigned char **out, size_t *num_syms) {
+    size_t n, least = num_syms[0];
+    int s;
+
+#ifdef CPU_X86
+    int features = cpu_features();
+
+    if (table->use_multi && (features & CPU_BMI2)) {
+        decode_x4_multi_bmi2(table, br, out, num_syms);
+        return;
+    }
+#endif
+    if (table->use_multi) {
+        decode_x4_multi_scalar(table, br, out, num_syms);
+        return;
+    }
+
+    // single symbol lookups keep the streams in lockstep
+    for (s = 1; s < 4; s++) if (num_syms[s] < least) least = num_syms[s];
+
+#ifdef CPU_X86
+    if (features & CPU_AVX2) {
+        n = decode_x4_avx2(table->entry, br, out, least);
+        unsigned char *rest[4] = {out[0] + n, out[1] + n, out[2] + n, out[3] + n};
+
+        // the vector loop leaves the last few symbols to the scalar one
+        n += decode_x4_bmi2(table->entry, br, rest, least - n);
+    } else if (features & CPU_BMI2) {
+        n = decode_x4_bmi2(table->entry, br, out, least);
+    } else
+#endif
+        n = decode_x4_scalar(table->entry, br, out, least);
+
+    for (s = 0; s < 4; s++) {
+        out[s] += n;
+        num_syms[s] -= n;
+    }
+}
+
+/******************************************************************************
+decode_symbols_context:
+Purpose:      Decodes symbols each coded with the table picked by the symbol
+              before it
+Parameters:   ctx - lookup tables from decode_context_build
+              br - bit reader positioned at the first code
+              out, num_syms - buffer for the decoded symbols
+              prev - byte before the first symbol, 0 at the start of a
+                     stream
+Return:       void
+Notes:        the reader must hold the end of the input. Every lookup waits
+              on the one before it, so the multi-symbol entries carry the
+              next table with them rather than leave it to another load
+******************************************************************************/
+void decode_symbols_context(const decode_context_t *ctx, bit_reader_t *br, unsigned char *out, size_t num_syms,
+                            int prev) {
+#ifdef CPU_X86
+    if (cpu_features() & CPU_BMI2) {
+        decode_context_bmi2(ctx, br, out, num_syms, prev);
+        return;
+    }
+#endif
+    decode_context_scalar(ctx, br, out, num_syms, prev);
+}
+
+/******************************************************************************
+decode_symbols_context_x4:
+Purpose:      Decodes four independent order-1 bitstreams side by side
+Parameters:   ctx - lookup tables from decode_context_build, shared by the
+                    streams, each of which starts after a 0
+              br, out, num_syms - as for decode_symbols_x4
+Return:       void
+Notes:        stops as decode_symbols_x4 does; the caller finishes each
+              stream with decode_symbols_context from the last byte it got
+******************************************************************************/
+void decode_symbols_context_x4(const decode_context_t *ctx, bit_reader_t *br, unsigned char **out, size_t *num_syms) {
+#ifdef CPU_X86
+    if (cpu_features() & CPU_BMI2) {
+        decode_context_x4_bmi2(ctx, br, out, num_syms);
+        return;
+    }
+#endif
+    decode_context_x4_scalar(ctx, br, out, num_syms);
+}
+
+// portable builds of the decode loops
+size_t decode_symbols_scalar(const uint32_t *entry, bit_reader_t *br, unsigned char *out, size_t num_syms,
+                             int final) {
+    return decode_kernel(entry, br, out, num_syms, final);
+}
+
+size_t decode_multi_scalar(const decode_table_t *table, bit_reader_t *br, unsigned char *out, size_t num_syms,
+                           int final) {
+    return decode_kernel_multi(table, br, out, num_syms, final);
+}
+
+void decode_x4_multi_scalar(const decode_table_t *table, bit_reader_t *br, unsigned char **out, size_t *num_syms) {
+    decode_kernel_multi_x4(table, br, out, num_syms);
+}
+
+size_t decode_x4_scalar(const uint32_t *entry, bit_reader_t *br, unsigned char *const *out, size_t num_syms) {
+    return decode_kernel_x4(entry, br, out, num_syms);
+}
+
+void decode_context_scalar(const decode_context_t *ctx, bit_reader_t *br, unsigned char *out, size_t num_syms,
+                           int prev) {
+    decode_kernel_context(ctx, br, out, num_syms, prev);
+}
+
+void decode_context_x4_scalar(const decode_context_t *ctx, bit_reader_t *br, unsigned char **out, size_t *num_syms) {
+    decode_kernel_context_x4(ctx, br, out, num_syms);
+}
+
+#ifdef CPU_X86
+// decode loops with shlx/shrx/bzhi for the bit buffer
+CPU_TARGET("bmi2") size_t decode_symbols_bmi2(const uint32_t *entry, bit_reader_t *br, unsigned char *out,
+                                              size_t num_syms, int final) {
+    return decode_kernel(entry, br, out, num_syms, final);
+}
+
+CPU_TARGET("bmi2") size_t decode_multi_bmi2(const decode_table_t *table, bit_reader_t *br, unsigned char *out,
+                                            size_t num_syms, int final) {
+    return decode_kernel_multi(table, br, out, num_syms, final);
+}
+
+CPU_TARGET("bmi2") void decode_x4_multi_bmi2(const decode_table_t *table, bit_reader_t *br, unsigned char **out,
+                                             size_t *num_syms) {
+    decode_kernel_multi_x4(table, br, out, num_syms);
+}
+
+CPU_TARGET("bmi2") size_t decode_x4_bmi2(const uint32_t *entry, bit_reader_t *br, unsigned char *const *out,
+                                         size_t num_syms) {
+    return decode_kernel_x4(entry, br, out, num_syms);
+}
+
+CPU_TARGET("bmi2") void decode_context_bmi2(const decode_context_t *ctx, bit_reader_t *br, unsigned char *out,
+                                            size_t num_syms, int prev) {
+    decode_kernel_context(ctx, br, out, num_syms, prev);
+}
+
+CPU_TARGET("bmi2") void decode_context_x4_bmi2(const decode_context_t *ctx, bit_reader_t *br, unsigned char **out,
+                                               size_t *num_syms) {
+    decode_kernel_context_x4(ctx, br, out, num_syms);
+}
+
+/******************************************************************************
+decode_x4_avx2:
+Purpose:      Decodes four bitstreams with their bit buffers in one vector
+Parameters:   entry - lookup tables for the prefix code
+              br - four bit readers, one per stream
+              out - four buffers for at least num_syms symbols each
+              num_syms - number of symbols wanted from every stream
+Return:       number of symbols decoded from each stream
+Notes:        each refill gathers 8 bytes per stream, leaving at least 56
+              bits, enough for four primary table lookups of at most
+              DECODE_TABLE_BITS bits each; a lookup that lands on a link
+              entry is finished with the scalar code. Stops while every
+              reader still has 8 bytes and 4 symbols to spare
+******************************************************************************/
+CPU_TARGET("avx2,bmi2") size_t decode_x4_avx2(const uint32_t *entry, bit_reader_t *br,
+                                              unsigned char *const *out, size_t num_syms) {
+    const unsigned char *base = br[0].ptr;
+    const __m256i swap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m256i k56 = _mm256_set1_epi64x(56), k63 = _mm256_set1_epi64x(63);
+    const __m128i bits_mask = _mm_set1_epi32(DECODE_BITS_MASK);
+    __m256i bits, count, pos, last, word, len;
+    __m128i e, sym;
+    size_t n = 0;
+    int i, k;
+
+    // stream positions as offsets from the first, which the gathers index
+    bits = _mm256_setr_epi64x(br[0].bits, br[1].bits, br[2].bits, br[3].bits);
+    count = _mm256_setr_epi64x(br[0].count, br[1].count, br[2].count, br[3].count);
+    pos = _mm256_setr_epi64x(0, br[1].ptr - base, br[2].ptr - base, br[3].ptr - base);
+    last = _mm256_setr_epi64x(br[0].end - base - 8, br[1].end - base - 8, br[2].end - base - 8,
+                              br[3].end - base - 8);
+
+    while (n + 4 <= num_syms && _mm256_movemask_epi8(_mm256_cmpgt_epi64(pos, last)) == 0) {
+        // refill: the next 8 bytes of each stream, most significant bit first
+        word = _mm256_i64gather_epi64((const long long *)base, pos, 1);
+        word = _mm256_shuffle_epi8(word, swap);
+        bits = _mm256_or_si256(bits, _mm256_srlv_epi64(word, count));
+        pos = _mm256_add_epi64(pos, _mm256_srli_epi64(_mm256_sub_epi64(k63, count), 3));
+        count = _mm256_or_si256(count, k56);
+
+        for (k = 0; k < 4; k++) {
+            e = _mm256_i64gather_epi32((const int *)entry, _mm256_srli_epi64(bits, 64 - DECODE_TABLE_BITS), 4);
+
+            // a long code in any stream, finish this step one stream at a time
+            if (_mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(e, 24))) != 0) {
+                uint64_t b[4], c[4], p[4];
+
+                _mm256_storeu_si256((__m256i *)b, bits);
+                _mm256_storeu_si256((__m256i *)c, count);
+                _mm256_storeu_si256((__m256i *)p, pos);
+                for (i = 0; i < 4; i++) {
+                    br[i].bits = b[i];
+                    br[i].count = c[i];
+                    br[i].ptr = base + p[i];
+                    out[i][n] = decode_next(entry, &br[i]);
+                }
+                bits = _mm256_setr_epi64x(br[0].bits, br[1].bits, br[2].bits, br[3].bits);
+                count = _mm256_setr_epi64x(br[0].count, br[1].count, br[2].count, br[3].count);
+                pos = _mm256_setr_epi64x(br[0].ptr - base, br[1].ptr - base, br[2].ptr - base, br[3].ptr - base);
+                n++;
+                break;
+            }
+
+            len = _mm256_cvtepu32_epi64(_mm_and_si128(e, bits_mask));
+            bits = _mm256_sllv_epi64(bits, len);
+            count = _mm256_sub_epi64(count, len);
+
+            sym = _mm_srli_epi32(e, 8);
+            out[0][n] = _mm_extract_epi32(sym, 0);
+            out[1][n] = _mm_extract_epi32(sym, 1);
+            out[2][n] = _mm_extract_epi32(sym, 2);
+            out[3][n] = _mm_extract_epi32(sym, 3);
+            n++;
+        }
+    }
+
+    // hand the bit buffers back to the readers
+    {
+        uint64_t b[4], c[4], p[4];
+
+        _mm256_storeu_si256((__m256i *)b, bits);
+        _mm256_storeu_si256((__m256i *)c, count);
+        _mm256_storeu_si256((__m256i *)p, pos);
+        for (i = 0; i < 4; i++) {
+            br[i].bits = b[i];
+            br[i].count = c[i];
+            br[i].ptr = base + p[i];
+        }
+    }
+
+    return n;
+}
+#endif
+
+// the single stream decode loop, inlined into each build of it
+DECODE_INLINE size_t decode_kernel(const uint32_t *entry, bit_reader_t *br, unsigned char *out, size_t num_syms,
+                                   int final) {
+    size_t n = 0;
+
+    while (n < num_syms) {
+        if (!final && br->end - br->ptr < 8) break;
+
+        out[n++] = decode_next(entry, br);
+    }
+
+    return n;
+}
+
+// the context decode loop, inlined into each build of it; laid out as
+// decode_kernel_multi with the table number t carried between lookups
+DECODE_INLINE void decode_kernel_context(const decode_context_t *ctx, bit_reader_t *br, unsigned char *out,
+                                         size_t num_syms, int prev) {
+    const uint64_t *multi = ctx->multi;
+    size_t n = 0;
+    uint64_t e;
+    int k, bits, t = ctx->map[prev];
+
+    while (n + 4 * DECODE_MULTI_MAX <= num_syms) {
+        bit_reader_refill(br);
+
+        for (k = 0; k < 4; k++) {
+            e = multi[(size_t)t << DECODE_CONTEXT_BITS | br->bits >> (64 - DECODE_CONTEXT_BITS)];
+            if ((e >> 32 & 0xff) == 0) {
+                out[n] = decode_next(ctx->table[t].entry, br);
+                t = ctx->map[out[n++]];
+                break;
+            }
+
+            out[n] = e;
+            out[n + 1] = e >> 8;
+            out[n + 2] = e >> 16;
+            out[n + 3] = e >> 24;
+            n += e >> 32 & 0xff;
+            bits = e >> 40 & 0xff;
+            br->bits <<= bits;
+            br->count -= bits;
+            t = e >> 48;
+        }
+    }
+
+    for (; n < num_syms; n++) {
+        out[n] = decode_next(ctx->table[t].entry, br);
+        t = ctx->map[out[n]];
+    }
+}
+
+/******************************************************************************
+decode_kernel_multi:
+Purpose:      The single stream decode loop with multi-symbol lookups,
+              inlined into each build of it
+Parameters:   as decode_symbols
+Return:       number of symbols decoded
+Notes:        a refill leaves at least 56 bits, room for four lookups of
+              DECODE_TABLE_BITS each; every lookup stores DECODE_MULTI_MAX
+              bytes and keeps the ones it decoded, so the last few symbols
+              go through the single-symbol loop. A lookup without whole
+              codes falls back to decode_next
+******************************************************************************/
+DECODE_INLINE size_t decode_kernel_multi(const decode_table_t *table, bit_reader_t *br, unsigned char *out,
+                                         size_t num_syms, int final) {
+    const uint64_t *multi = table->multi;
+    size_t n = 0;
+    uint64_t e;
+    int k, bits;
+
+    while (n + 4 * DECODE_MULTI_MAX <= num_syms) {
+        if (!final && br->end - br->ptr < 8) return n;
+
+        bit_reader_refill(br);
+
+        for (k = 0; k < 4; k++) {
+            e = multi[br->bits >> (64 - DECODE_TABLE_BITS)];
+            if ((e >> 32 & 0xff) == 0) {
+                if (!final && br->end - br->ptr < 8) return n;
+                out[n++] = decode_next(table->entry, br);
+                break;
+            }
+
+            out[n] = e;
+            out[n + 1] = e >> 8;
+            out[n + 2] = e >> 16;
+            out[n + 3] = e >> 24;
+            n += e >> 32 & 0xff;
+            bits = e >> 40;
+            br->bits <<= bits;
+            br->count -= bits;
+        }
+    }
+
+    return n + decode_kernel(table->entry, br, out + n, num_syms - n, final);
+}
+
+// the four stream decode loop, inlined into each build of it
+DECODE_INLINE size_t decode_kernel_x4(const uint32_t *entry, bit_reader_t *br, unsigned char *const *out,
+                                      size_t num_syms) {
+    bit_reader_t r0 = br[0], r1 = br[1], r2 = br[2], r3 = br[3];
+    unsigned char *o0 = out[0], *o1 = out[1], *o2 = out[2], *o3 = out[3];
+    size_t n;
+
+    for (n = 0; n < num_syms; n++) {
+        if (r0.end - r0.ptr < 8 || r1.end - r1.ptr < 8 || r2.end - r2.ptr < 8 || r3.end - r3.ptr < 8) break;
+
+        o0[n] = decode_next(entry, &r0);
+        o1[n] = decode_next(entry, &r1);
+        o2[n] = decode_next(entry, &r2);
+        o3[n] = decode_next(entry, &r3);
+    }
+
+    br[0] = r0;
+    br[1] = r1;
+    br[2] = r2;
+    br[3] = r3;
+    return n;
+}
+
+// the four stream loop with multi-symbol lookups, inlined into each build of it
+DECODE_INLINE void decode_kernel_multi_x4(const decode_table_t *table, bit_reader_t *br, unsigned char **out,
+                                          size_t *num_syms) {
+    bit_reader_t r0 = br[0], r1 = br[1], r2 = br[2], r3 = br[3];
+    unsigned char *o0 = out[0], *o1 = out[1], *o2 = out[2], *o3 = out[3];
+    size_t n0 = num_syms[0], n1 = num_syms[1], n2 = num_syms[2], n3 = num_syms[3];
+
+    // every lookup may store DECODE_MULTI_MAX bytes
+    while (n0 >= DECODE_MULTI_MAX && n1 >= DECODE_MULTI_MAX && n2 >= DECODE_MULTI_MAX && n3 >= DECODE_MULTI_MAX) {
+        if (r0.end - r0.ptr < 8 || r1.end - r1.ptr < 8 || r2.end - r2.ptr < 8 || r3.end - r3.ptr < 8) break;
+
+        decode_step_multi(table, &r0, &o0, &n0);
+        decode_step_multi(table, &r1, &o1, &n1);
+        decode_step_multi(table, &r2, &o2, &n2);
+        decode_step_multi(table, &r3, &o3, &n3);
+    }
+
+    br[0] = r0;
+    br[1] = r1;
+    br[2] = r2;
+    br[3] = r3;
+    out[0] = o0;
+    out[1] = o1;
+    out[2] = o2;
+    out[3] = o3;
+    num_syms[0] = n0;
+    num_syms[1] = n1;
+    num_syms[2] = n2;
+    num_syms[3] = n3;
+}
+
+// decode the whole codes in the next DECODE_TABLE_BITS bits of a stream,
+// refilling first if fewer bits than that are buffered
+DECODE_INLINE void decode_step_multi(const decode_table_t *table, bit_reader_t *br, unsigned char **out,
+                                     size_t *num_syms) {
+    unsigned char *o = *out;
+    uint64_t e;
+    int count, bits;
+
+    if (br->count < DECODE_TABLE_BITS) bit_reader_refill(br);
+
+    e = table->multi[br->bits >> (64 - DECODE_TABLE_BITS)];
+    count = e >> 32 & 0xff;
+
+    if (count == 0) {
+        *o = decode_next(table->entry, br);
+        count = 1;
+    } else {
+        o[0] = e;
+        o[1] = e >> 8;
+        o[2] = e >> 16;
+        o[3] = e >> 24;
+        bits = e >> 40;
+        br->bits <<= bits;
+        br->count -= bits;
+    }
+
+    *out = o + count;
+    *num_syms -= count;
+}
+
+// the four stream order-1 decode loop, inlined into each build of it
+DECODE_INLINE void decode_kernel_context_x4(const decode_context_t *ctx, bit_reader_t *br, unsigned char **out,
+                                            size_t *num_syms) {
+    bit_reader_t r0 = br[0], r1 = br[1], r2 = br[2], r3 = br[3];
+    unsigned char *o0 = out[0], *o1 = out[1], *o2 = out[2], *o3 = out[3];
+    size_t n0 = num_syms[0], n1 = num_syms[1], n2 = num_syms[2], n3 = num_syms[3];
+    int t0 = ctx->map[0], t1 = t0, t2 = t0, t3 = t0;
+
+    // every lookup may store DECODE_MULTI_MAX bytes
+    while (n0 >= DECODE_MULTI_MAX && n1 >= DECODE_MULTI_MAX && n2 >= DECODE_MULTI_MAX && n3 >= DECODE_MULTI_MAX) {
+        if (r0.end - r0.ptr < 8 || r1.end - r1.ptr < 8 || r2.end - r2.ptr < 8 || r3.end - r3.ptr < 8) break;
+
+        decode_step_context(ctx, &r0, &o0, &n0, &t0);
+        decode_step_context(ctx, &r1, &o1, &n1, &t1);
+        decode_step_context(ctx, &r2, &o2, &n2, &t2);
+        decode_step_context(ctx, &r3, &o3, &n3, &t3);
+    }
+
+    br[0] = r0;
+    br[1] = r1;
+    br[2] = r2;
+    br[3] = r3;
+    out[0] = o0;
+    out[1] = o1;
+    out[2] = o2;
+    out[3] = o3;
+    num_syms[0] = n0;
+    num_syms[1] = n1;
+    num_syms[2] = n2;
+    num_syms[3] = n3;
+}
+
+// one order-1 multi-symbol lookup of a stream, t being its current table
+DECODE_INLINE void decode_step_context(const decode_context_t *ctx, bit_reader_t *br, unsigned char **out,
+                                       size_t *num_syms, int *t) {
+    unsigned char *o = *out;
+    uint64_t e;
+    int count, bits;
+
+    if (br->count < DECODE_CONTEXT_BITS) bit_reader_refill(br);
+
+    e = ctx->multi[(size_t)*t << DECODE_CONTEXT_BITS | br->bits >> (64 - DECODE_CONTEXT_BITS)];
+    count = e >> 32 & 0xff;
+
+    if (count == 0) {
+        *o = decode_next(ctx->table[*t].entry, br);
+        *t = ctx->map[*o];
+        count = 1;
+    } else {
+        o[0] = e;
+        o[1] = e >> 8;
+        o[2] = e >> 16;
+        o[3] = e >> 24;
+        bits = e >> 40 & 0xff;
+        br->bits <<= bits;
+        br->count -= bits;
+        *t = e >> 48;
+    }
+
+    *out = o + count;
+    *num_syms -= count;
+}
+
+// decode the code at the front of a bit reader
+DECODE_INLINE unsigned char decode_next(const uint32_t *entry, bit_reader_t *br) {
+    uint32_t e;
+    int sub;
+
+    bit_reader_refill(br);
+    e = entry[br->bits >> (64 - DECODE_TABLE_BITS)];
+
+    // long code, walk down the secondary tables
+    if (e & DECODE_LINK) {
+        br->bits <<= DECODE_TABLE_BITS;
+        br->count -= DECODE_TABLE_BITS;
+
+        do {
+            sub = e & DECODE_BITS_MASK;
+            e = entry[(e >> 8) + (br->bits >> (64 - sub))];
+            if (e & DECODE_LINK) {
+                br->bits <<= sub;
+                br->count -= sub;
+            }
+        } while (e & DECODE_LINK);
+    }
+
+    br->bits <<= e & DECODE_BITS_MASK;
+    br->count -= e & DECODE_BITS_MASK;
+    return e >> 8;
+}
@@ -0,0 +1,70 @@
+//
+//  decode.h
+//  API for table-driven Huffman decoding
+//  resolves a whole code per table lookup instead of one bit per tree step
+//
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include "codes.h"
+
+#define DECODE_TABLE_BITS 12      // bits resolved by the primary table
+#define DECODE_MAX_CODE_LEN 56    // longest code held by the bit buffer after a refill
+
+// table entry layout: value << 8 | link flag | bits
+// symbol entries hold the symbol and the bits it uses at that level,
+// link entries hold the offset and index bits of a secondary table
+#define DECODE_LINK 0x80
+#define DECODE_BITS_MASK 0x7f
+
+// multi-symbol entry layout: bits << 40 | count << 32 | symbols, one per
+// byte with the first lowest; a count of 0 sends the code to the entries
+// above. Built only when the codes are short enough to pay off
+#define DECODE_MULTI_MAX 4        // symbols per multi-symbol entry
+#define DECODE_MULTI_AVG_LEN 8    // longest average code length given a multi-symbol table
+#define DECODE_CONTEXT_TABLES 16  // tables of an order-1 code
+#define DECODE_CONTEXT_BITS 10    // index bits of its multi-symbol entries, fewer to stay in cache
+
+typedef struct decode_table_tag {
+    uint32_t *entry;      // primary table followed by secondary tables
+    int num_entries;
+    int max_entries;
+    uint64_t *multi;      // 1 << DECODE_TABLE_BITS multi-symbol entries
+    int use_multi;        // multi is built for the current code
+} decode_table_t;
+
+// lookup tables of an order-1 code, each symbol coded with the table the
+// symbol before it picks. Its multi-symbol entries switch tables as they
+// go and also hold the table of the symbol after them:
+// next table << 48 | bits << 40 | count << 32 | symbols
+typedef struct decode_context_tag {
+    decode_table_t table[DECODE_CONTEXT_TABLES];    // no multi-symbol tables of their own
+    unsigned char map[NUM_SYMS];    // table picked by each byte
+    int num_tables;
+    uint64_t *multi;                // 1 << DECODE_CONTEXT_BITS entries per table
+} decode_context_t;
+
+typedef struct bit_reader_tag {
+    const unsigned char *ptr;   // next byte to load into the buffer
+    const unsigned char *end;   // end of the available input
+    uint64_t bits;              // unread bits, most significant bit first
+    int count;                  // number of valid bits in buffer
+} bit_reader_t;
+
+// public prototype definitions for decode.c
+int decode_table_build(decode_table_t *table, const huffman_codes_t *codes);
+void decode_table_free(decode_table_t *table);
+void bit_reader_init(bit_reader_t *br, const unsigned char *buf, size_t len);
+void bit_reader_fill(bit_reader_t *br);
+size_t decode_symbols(const decode_table_t *table, bit_reader_t *br, unsigned char *out, size_t num_syms, int final);
+void decode_symbols_x4(const decode_table_t *table, bit_reader_t *br, unsigned char **out, size_t *num_syms);
+int decode_context_build(decode_context_t *ctx, const huffman_codes_t (*codes)[NUM_SYMS], int num_tables,
+                         const unsigned char *map);
+void decode_context_free(decode_context_t *ctx);
+void decode_symbols_context(const decode_context_t *ctx, bit_reader_t *br, unsigned char *out, size_t num_syms,
+                            int prev);
+void decode_symbols_context_x4(const decode_context_t *ctx, bit_reader_t *br, unsigned char **out, size_t *num_syms);
+
+#endif
@@ -0,0 +1,365 @@
+//
+//  encode.c
+//  API for Huffman encoding with a 64-bit bit accumulator
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "encode.h"
+#include "cpu.h"
+#include "stats.h"
+
+// prototypes for private functions used in encode.c only
+static inline void encode_kernel(const huffman_codes_t *, bit_writer_t *, const unsigned char *, size_t)
+    __attribute__((always_inline));
+void encode_symbols_scalar(const huffman_codes_t *, bit_writer_t *, const unsigned char *, size_t);
+void encode_symbols_bmi2(const huffman_codes_t *, bit_writer_t *, const unsigned char *, size_t);
+static inline void encode_pairs_kernel(const encode_pairs_t *, bit_writer_t *, const unsigned char *, size_t)
+    __attribute__((always_inline));
+void encode_pairs_scalar(const encode_pairs_t *, bit_writer_t *, const unsigned char *, size_t);
+void encode_pairs_bmi2(const encode_pairs_t *, bit_writer_t *, const unsigned char *, size_t);
+static inline void encode_context_kernel(const huffman_codes_t *const *, int, bit_writer_t *, const unsigned char *,
+                                         size_t) __attribute__((always_inline));
+void encode_context_scalar(const huffman_codes_t *const *, int, bit_writer_t *, const unsigned char *, size_t);
+void encode_context_bmi2(const huffman_codes_t *const *, int, bit_writer_t *, const unsigned char *, size_t);
+
+/* Returns the most bytes encode_symbols can store for num_syms symbols,
+ * including the slack written past the last whole byte.
+ */
+size_t encode_bound(const huffman_codes_t *codes, size_t num_syms) {
+    int i, max_len = 0;
+
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len > max_len) max_len = codes[i].code_len;
+    }
+
+    return (num_syms * max_len + 7) / 8 + 8;
+}
+
+/* Points a bit writer at the start of an output buffer
+ */
+void bit_writer_init(bit_writer_t *bw, unsigned char *buf) {
+    bw->ptr = buf;
+    bw->bits = 0;
+    bw->count = 0;
+}
+
+/******************************************************************************
+encode_symbols:
+Purpose:      Appends the codes for a buffer of symbols to a bit writer
+Parameters:   codes - code table indexed by symbol
+              bw - bit writer, pending bits are carried between calls
+              in - symbols to encode
+              num_syms - number of symbols
+Return:       void
+Notes:        every code word is ORed into the accumulator and all 8 bytes
+              are stored, then the pointer advances by the whole bytes
+              written; the output needs encode_bound bytes of room. Runs
+              the BMI2 build of the loop when the CPU has it, the output
+              is the same either way
+******************************************************************************/
+void encode_symbols(const huffman_codes_t *codes, bit_writer_t *bw, const unsigned char *in, size_t num_syms) {
+#ifdef CPU_X86
+    if (cpu_features() & CPU_BMI2) {
+        encode_symbols_bmi2(codes, bw, in, num_syms);
+        return;
+    }
+#endif
+    encode_symbols_scalar(codes, bw, in, num_syms);
+}
+
+// portable build of the encode loop
+void encode_symbols_scalar(const huffman_codes_t *codes, bit_writer_t *bw, const unsigned char *in,
+                           size_t num_syms) {
+    encode_kernel(codes, bw, in, num_syms);
+}
+
+#ifdef CPU_X86
+// encode loop with shlx/shrx for the variable shifts of the accumulator
+CPU_TARGET("bmi2") void encode_symbols_bmi2(const huffman_codes_t *codes, bit_writer_t *bw,
+                                            const unsigned char *in, size_t num_syms) {
+    encode_kernel(codes, bw, in, num_syms);
+}
+#endif
+
+// the encode loop, inlined into each build of it
+static inline void encode_kernel(const huffman_codes_t *codes, bit_writer_t *bw, const unsigned char *in,
+                                 size_t num_syms) {
+    unsigned char *ptr = bw->ptr;
+    uint64_t bits = bw->bits;
+    int count = bw->count;
+    size_t i;
+
+    for (i = 0; i < num_syms; i++) {
+        const huffman_codes_t *c = &codes[in[i]];
+
+        count += c->code_len;
+        bits |= c->code << (64 - count);
+
+        ptr[0] = bits >> 56;
+        ptr[1] = bits >> 48;
+        ptr[2] = bits >> 40;
+        ptr[3] = bits >> 32;
+        ptr[4] = bits >> 24;
+        ptr[5] = bits >> 16;
+        ptr[6] = bits >> 8;
+        ptr[7] = bits;
+        ptr += count >> 3;
+        bits <<= count & ~7;
+        count &= 7;
+    }
+
+    bw->ptr = ptr;
+    bw->bits = bits;
+    bw->count = count;
+}
+
+/******************************************************************************
+encode_pairs_build:
+Purpose:      Builds the pair table for a code
+Parameters:   pairs - zeroed or previously built table, its memory is reused
+                      and released with encode_pairs_free
+              codes - code table indexed by symbol, no code longer than
+                      ENCODE_PAIR_MAX_LEN
+Return:       0 on success, -1 if a code is too long or out of memory
+Notes:        returns at once if the table was last built for the same
+              code, as for a block reusing the previous block's table
+******************************************************************************/
+int encode_pairs_build(encode_pairs_t *pairs, const huffman_codes_t *codes) {
+    const huffman_codes_t *a, *b;
+    uint32_t *e;
+    int i, j;
+
+    if (pairs->valid && memcmp(pairs->codes, codes, sizeof(pairs->codes)) == 0) return 0;
+
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len > ENCODE_PAIR_MAX_LEN) return -1;
+    }
+
+    if (pairs->entry == NULL) {
+        pairs->entry = (uint32_t *)malloc(sizeof(uint32_t) * NUM_SYMS * NUM_SYMS);
+        STATS_ALLOC();
+        if (pairs->entry == NULL) return -1;
+    }
+
+    for (i = 0, e = pairs->entry; i < NUM_SYMS; i++) {
+        a = &codes[i];
+        for (j = 0, b = codes; j < NUM_SYMS; j++, b++)
+            *e++ = (uint32_t)(a->code << b->code_len | b->code) << 8 | (a->code_len + b->code_len);
+    }
+
+    memcpy(pairs->codes, codes, sizeof(pairs->codes));
+    pairs->valid = 1;
+    return 0;
+}
+
+/* Releases the memory held by a pair table
+ */
+void encode_pairs_free(encode_pairs_t *pairs) {
+    free(pairs->entry);
+    pairs->entry = NULL;
+    pairs->valid = 0;
+}
+
+/******************************************************************************
+encode_pairs_symbols:
+Purpose:      Appends the codes for a buffer of symbols to a bit writer, two
+              symbols per table lookup
+Parameters:   pairs - pair table from encode_pairs_build
+              bw - bit writer, pending bits are carried between calls
+              in - symbols to encode
+              num_syms - number of symbols
+Return:       void
+Notes:        two pairs of at most 24 bits go into the accumulator per
+              store, so the loop runs once per four symbols; the output is
+              the same as from encode_symbols with the same code
+******************************************************************************/
+void encode_pairs_symbols(const encode_pairs_t *pairs, bit_writer_t *bw, const unsigned char *in, size_t num_syms) {
+#ifdef CPU_X86
+    if (cpu_features() & CPU_BMI2) {
+        encode_pairs_bmi2(pairs, bw, in, num_syms);
+        return;
+    }
+#endif
+    encode_pairs_scalar(pairs, bw, in, num_syms);
+}
+
+// portable build of the pair encode loop
+void encode_pairs_scalar(const encode_pairs_t *pairs, bit_writer_t *bw, const unsigned char *in, size_t num_syms) {
+    encode_pairs_kernel(pairs, bw, in, num_syms);
+}
+
+#ifdef CPU_X86
+// pair encode loop with shlx/shrx for the variable shifts of the accumulator
+CPU_TARGET("bmi2") void encode_pairs_bmi2(const encode_pairs_t *pairs, bit_writer_t *bw, const unsigned char *in,
+                                          size_t num_syms) {
+    encode_pairs_kernel(pairs, bw, in, num_syms);
+}
+#endif
+
+// the pair encode loop, inlined into each build of it
+static inline void encode_pairs_kernel(const encode_pairs_t *pairs, bit_writer_t *bw, const unsigned char *in,
+                                       size_t num_syms) {
+    const uint32_t *entry = pairs->entry;
+    unsigned char *ptr = bw->ptr;
+    uint64_t bits = bw->bits;
+    int count = bw->count;
+    uint32_t e0, e1;
+    size_t i;
+
+    // at most 7 pending bits plus two pairs of 24 fit the accumulator
+    for (i = 0; i + 4 <= num_syms; i += 4) {
+        e0 = entry[in[i] << 8 | in[i + 1]];
+        e1 = entry[in[i + 2] << 8 | in[i + 3]];
+
+        count += e0 & 0xff;
+        bits |= (uint64_t)(e0 >> 8) << (64 - count);
+        count += e1 & 0xff;
+        bits |= (uint64_t)(e1 >> 8) << (64 - count);
+
+        ptr[0] = bits >> 56;
+        ptr[1] = bits >> 48;
+        ptr[2] = bits >> 40;
+        ptr[3] = bits >> 32;
+        ptr[4] = bits >> 24;
+        ptr[5] = bits >> 16;
+        ptr[6] = bits >> 8;
+        ptr[7] = bits;
+        ptr += count >> 3;
+        bits <<= count & ~7;
+        count &= 7;
+    }
+
+    bw->ptr = ptr;
+    bw->bits = bits;
+    bw->count = count;
+
+    // the last few symbols one at a time
+    encode_kernel(pairs->codes, bw, in + i, num_syms - i);
+}
+
+/******************************************************************************
+encode_symbols_context:
+Purpose:      Appends the codes for a buffer of symbols to a bit writer, each
+              from the table picked by the symbol before it
+Parameters:   codes - code table for each preceding byte, the first symbol
+                      is coded as if it followed a 0
+              max_len - longest code in any of the tables
+              bw - bit writer, pending bits are carried between calls
+              in - symbols to encode
+              num_syms - number of symbols
+Return:       void
+Notes:        the table switch is one more load per symbol; codes of up to
+              ENCODE_CONTEXT_PAIR_LEN bits are joined two at a time before
+              they go into the accumulator, halving the stores. The output
+              needs the room encode_bound gives for the longest code
+******************************************************************************/
+void encode_symbols_context(const huffman_codes_t *const *codes, int max_len, bit_writer_t *bw,
+                            const unsigned char *in, size_t num_syms) {
+#ifdef CPU_X86
+    if (cpu_features() & CPU_BMI2) {
+        encode_context_bmi2(codes, max_len, bw, in, num_syms);
+        return;
+    }
+#endif
+    encode_context_scalar(codes, max_len, bw, in, num_syms);
+}
+
+// portable build of the context encode loop
+void encode_context_scalar(const huffman_codes_t *const *codes, int max_len, bit_writer_t *bw,
+                           const unsigned char *in, size_t num_syms) {
+    encode_context_kernel(codes, max_len, bw, in, num_syms);
+}
+
+#ifdef CPU_X86
+// context encode loop with shlx/shrx for the variable shifts of the accumulator
+CPU_TARGET("bmi2") void encode_context_bmi2(const huffman_codes_t *const *codes, int max_len, bit_writer_t *bw,
+                                           const unsigned char *in, size_t num_syms) {
+    encode_context_kernel(codes, max_len, bw, in, num_syms);
+}
+#endif
+
+// the context encode loop, inlined into each build of it
+static inline void encode_context_kernel(const huffman_codes_t *const *codes, int max_len, bit_writer_t *bw,
+                                         const unsigned char *in, size_t num_syms) {
+    const huffman_codes_t *table = codes[0], *a, *b;
+    unsigned char *ptr = bw->ptr;
+    uint64_t bits = bw->bits;
+    int count = bw->count;
+    size_t i = 0;
+
+    // two codes at a time, joined while the accumulator holds them both
+    if (max_len <= ENCODE_CONTEXT_PAIR_LEN) {
+        for (; i + 2 <= num_syms; i += 2) {
+            a = &table[in[i]];
+            b = &codes[in[i]][in[i + 1]];
+            table = codes[in[i + 1]];
+            count += a->code_len + b->code_len;
+            bits |= (a->code << b->code_len | b->code) << (64 - count);
+
+            ptr[0] = bits >> 56;
+            ptr[1] = bits >> 48;
+            ptr[2] = bits >> 40;
+            ptr[3] = bits >> 32;
+            ptr[4] = bits >> 24;
+            ptr[5] = bits >> 16;
+            ptr[6] = bits >> 8;
+            ptr[7] = bits;
+            ptr += count >> 3;
+            bits <<= count & ~7;
+            count &= 7;
+        }
+    }
+
+    for (; i < num_syms; i++) {
+        a = &table[in[i]];
+        table = codes[in[i]];
+        count += a->code_len;
+        bits |= a->code << (64 - count);
+
+        ptr[0] = bits >> 56;
+        ptr[1] = bits >> 48;
+        ptr[2] = bits >> 40;
+        ptr[3] = bits >> 32;
+        ptr[4] = bits >> 24;
+        ptr[5] = bits >> 16;
+        ptr[6] = bits >> 8;
+        ptr[7] = bits;
+        ptr += count >> 3;
+        bits <<= count & ~7;
+        count &= 7;
+    }
+
+    bw->ptr = ptr;
+    bw->bits = bits;
+    bw->count = count;
+}
+
+/* Appends one code of up to 32 bits to a bit writer; like encode_symbols,
+ * all 8 bytes at the pointer are stored
+ */
+void bit_writer_put(bit_writer_t *bw, uint64_t code, int len) {
+    unsigned char *ptr = bw->ptr;
+    int i;
+
+    bw->count += len;
+    bw->bits |= code << (64 - bw->count);
+
+    for (i = 0; i < 8; i++) ptr[i] = bw->bits >> (56 - 8 * i);
+    bw->ptr += bw->count >> 3;
+    bw->bits <<= bw->count & ~7;
+    bw->count &= 7;
+}
+
+/* Stores the remaining pending bits, padding the last byte with zeros
+ */
+void bit_writer_flush(bit_writer_t *bw) {
+    while (bw->count > 0) {
+        *bw->ptr++ = bw->bits >> 56;
+        bw->bits <<= 8;
+        bw->count -= 8;
+    }
+
+    bw->bits = 0;
+    bw->count = 0;
+}
@@ -0,0 +1,42 @@
+//
+//  encode.h
+//  API for Huffman encoding with a 64-bit bit accumulator
+//
+
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+#include "codes.h"
+
+#define ENCODE_PAIR_MAX_LEN 12            // longest code the pair table holds
+#define ENCODE_PAIR_MIN_SYMS (1 << 17)    // symbols a block needs to pay for building one
+#define ENCODE_CONTEXT_PAIR_LEN 28        // longest code order-1 coding stores two at a time
+
+// code words for every two-symbol sequence, entry (first << 8 | second)
+// holds both codes concatenated, code << 8 | bits
+typedef struct encode_pairs_tag {
+    uint32_t *entry;
+    huffman_codes_t codes[NUM_SYMS];    // code the entries were built from
+    int valid;
+} encode_pairs_t;
+
+typedef struct bit_writer_tag {
+    unsigned char *ptr;   // next byte to store
+    uint64_t bits;        // pending bits, most significant bit first
+    int count;            // number of pending bits
+} bit_writer_t;
+
+// public prototype definitions for encode.c
+size_t encode_bound(const huffman_codes_t *codes, size_t num_syms);
+void bit_writer_init(bit_writer_t *bw, unsigned char *buf);
+void encode_symbols(const huffman_codes_t *codes, bit_writer_t *bw, const unsigned char *in, size_t num_syms);
+void bit_writer_put(bit_writer_t *bw, uint64_t code, int len);
+void bit_writer_flush(bit_writer_t *bw);
+int encode_pairs_build(encode_pairs_t *pairs, const huffman_codes_t *codes);
+void encode_pairs_free(encode_pairs_t *pairs);
+void encode_pairs_symbols(const encode_pairs_t *pairs, bit_writer_t *bw, const unsigned char *in, size_t num_syms);
+void encode_symbols_context(const huffman_codes_t *const *codes, int max_len, bit_writer_t *bw,
+                            const unsigned char *in, size_t num_syms);
+
+#endif
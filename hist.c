@@ -0,0 +1,93 @@
+//
+//  hist.c
+//  API for byte histogram counting
+//  counts into flat arrays instead of a symbol list
+//
+
+#include <string.h>
+#include "hist.h"
+#include "stats.h"
+
+// bytes counted before the 32-bit sub-histograms are folded into the totals
+#define HIST_FOLD_SPAN (1UL << 30)
+
+// prototypes for private functions used in hist.c only
+void hist_count_span(hist_t *, const unsigned char *, size_t);
+void hist_fold(hist_t *);
+
+/* Clears all counts so the histogram can be reused for a new input
+ */
+void hist_reset(hist_t *hist) {
+    memset(hist, 0, sizeof(hist_t));
+}
+
+/* Adds the symbols of a buffer to the histogram
+ *
+ * May be called repeatedly to count an input in pieces; count[] and total
+ * always hold the running totals on return.
+ */
+void hist_update(hist_t *hist, const unsigned char *buf, size_t len) {
+    size_t span, pos;
+
+    STATS_BEGIN(STATS_HISTOGRAM);
+    for (pos = 0; pos < len; pos += span) {
+        span = len - pos < HIST_FOLD_SPAN ? len - pos : HIST_FOLD_SPAN;
+        hist_count_span(hist, buf + pos, span);
+        hist_fold(hist);
+    }
+    STATS_END(len);
+}
+
+/******************************************************************************
+hist_count_span:
+Purpose:      Counts a buffer into the interleaved sub-histograms
+Parameters:   hist - histogram with cleared sub-histograms
+              buf, len - bytes to be counted (len <= HIST_FOLD_SPAN)
+Return:       void
+Notes:        consecutive bytes go to different sub-histograms so a run of
+              one symbol does not serialize on a single counter
+******************************************************************************/
+void hist_count_span(hist_t *hist, const unsigned char *buf, size_t len) {
+    uint32_t *c0 = hist->sub[0];
+    uint32_t *c1 = hist->sub[1];
+    uint32_t *c2 = hist->sub[2];
+    uint32_t *c3 = hist->sub[3];
+    uint32_t w0, w1;
+    size_t i = 0;
+
+    // two 32-bit words per step, one byte lane per sub-histogram
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w0, buf + i, 4);
+        memcpy(&w1, buf + i + 4, 4);
+        c0[w0 & 0xff]++;
+        c1[(w0 >> 8) & 0xff]++;
+        c2[(w0 >> 16) & 0xff]++;
+        c3[w0 >> 24]++;
+        c0[w1 & 0xff]++;
+        c1[(w1 >> 8) & 0xff]++;
+        c2[(w1 >> 16) & 0xff]++;
+        c3[w1 >> 24]++;
+    }
+
+    for (; i < len; i++)
+        c0[buf[i]]++;
+
+    hist->total += len;
+}
+
+/******************************************************************************
+hist_fold:
+Purpose:      Sums the sub-histograms into the 64-bit totals and clears them
+Parameters:   hist - histogram to fold
+Return:       void
+******************************************************************************/
+void hist_fold(hist_t *hist) {
+    int i, j;
+
+    for (i = 0; i < HIST_SYMS; i++) {
+        for (j = 0; j < HIST_WAYS; j++)
+            hist->count[i] += hist->sub[j][i];
+    }
+
+    memset(hist->sub, 0, sizeof(hist->sub));
+}
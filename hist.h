@@ -0,0 +1,27 @@
+//
+//  hist.h
+//  API for byte histogram counting
+//  counts into flat arrays instead of a symbol list
+//
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIST_SYMS 256
+#define HIST_WAYS 4       // interleaved sub-histograms
+
+typedef struct hist_tag {
+    uint64_t count[HIST_SYMS];    // frequency of each symbol
+    uint64_t total;               // number of bytes counted
+    // private scratch for hist.c only
+    uint32_t sub[HIST_WAYS][HIST_SYMS];
+} hist_t;
+
+// public prototype definitions for hist.c
+void hist_reset(hist_t *hist);
+void hist_update(hist_t *hist, const unsigned char *buf, size_t len);
+
+#endif
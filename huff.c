@@ -10,402 +10,591 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
 #include "list.h"
-
-#define NUM_SYMS 256
-
-typedef struct huffman_codes_tag {
-    unsigned char symbol;
-    unsigned char *code;
-    int code_len;
-} huffman_codes_t;
-
-void huffman_compress(FILE *, char *);
-void huffman_decompress(FILE *, char *, int);
-void huffman_encode(FILE *, FILE *, huffman_codes_t *);
-void huffman_decode(FILE *, FILE *, list_t *, int);
+#include "codes.h"
+#include "mapio.h"
+#include "pipeio.h"
+#include "libhuff.h"
+#include "bench.h"
+#include "stats.h"
+
+typedef struct huff_options_tag {
+    int max_len;            // code length limit
+    size_t block_size;      // bytes of input per block
+    int num_threads;        // coding threads
+    int num_streams;        // bitstreams per coded block
+    int mode;               // HUFF_MODE_STATIC, HUFF_MODE_ADAPTIVE or HUFF_MODE_ORDER1
+    int verbose;            // report statistics
+    int to_stdout;          // write output to standard output
+    int iterations;         // timed runs in benchmark mode
+    int format;             // benchmark report format
+    int stats;              // print per-stage statistics as JSON
+} huff_options_t;
+
+void huffman_compress(FILE *, char *, huff_options_t *);
+void huffman_decompress(FILE *, char *, int, huff_options_t *);
+void huffman_bench(FILE *, char *, huff_options_t *);
+unsigned char *read_input(FILE *, size_t *);
+int stream_compress(huff_cctx_t *, map_file_t *, int, uint64_t *, uint64_t *);
+int stream_decompress(huff_dctx_t *, map_file_t *, int);
 FILE *create_output_file(char *, int);
-void calc_freq(FILE *, list_t *, int *);
-void store_freq_table(FILE *, list_t *, int);
-list_t *read_freq_table(FILE *, int *);
-void build_tree(list_t *);
-huffman_codes_t *build_codes(list_t *, int);
-void build_codes_rec(list_node_t *, huffman_codes_t *, int *, int, int *);
-int compare(const data_t *, const data_t *);
-int compare_freq(const data_t *, const data_t *);
+size_t parse_size(const char *);
+void print_usage(void);
 
 // debugging functions
 void list_debug_print(list_t *);
 void debug_print_tree(list_t *);
 void ugly_print(list_node_t *, int);
-void debug_print_huffman_codes(huffman_codes_t *, int);
+void debug_print_huffman_codes(huffman_codes_t *);
+
+// long options, each mapped to a short option letter not otherwise used
+const struct option long_opts[] = {
+    {"stats", required_argument, NULL, 'S'},
+    {NULL, 0, NULL, 0}
+};
 
 int main(int argc, char *const *argv) {
     FILE    *fpt_in;
-    int     c, len;
-
-    if (argc != 3) {
-        fprintf(stderr, "Usage: ./huff -flag <file>\n");
-        printf("Command line options\n");
-        printf("Options -----------------\n");
-        printf("  -c\tcompress file using Huffman codec\n");
-        printf("  -d\tdecompress file using Huffman codec\n");
-        exit(0);
-    }
-
-    // open file to be compressed
-    fpt_in = fopen(argv[2], "rb"); // FILE SIZE LIMITED TO 4GB
+    int     c, len, mode = 0;
+    char    *filename;
+    huff_options_t opts;
+
+    opts.max_len = HUFF_DEFAULT_MAX_LEN;
+    opts.block_size = HUFF_DEFAULT_BLOCK_SIZE;
+    opts.num_threads = 1;
+    opts.num_streams = HUFF_DEFAULT_STREAMS;
+    opts.mode = HUFF_MODE_STATIC;
+    opts.verbose = 0;
+    opts.to_stdout = 0;
+    opts.iterations = 10;
+    opts.format = BENCH_TEXT;
+    opts.stats = 0;
 
     // command line argument handling
-    while ((c = getopt(argc, argv, "cd")) != -1)
+    while ((c = getopt_long(argc, argv, "AbcdOsB:F:I:L:N:T:v", long_opts, NULL)) != -1)
         switch (c) {
-        case 'c': // compress
-            huffman_compress(fpt_in, argv[2]);
+        case 'S': // --stats=json
+            if (strcmp(optarg, "json") != 0) {
+                fprintf(stderr, "Statistics format must be json!\n");
+                exit(1);
+            }
+            if (!stats_enabled()) {
+                fprintf(stderr, "Built without statistics, rebuild with make STATS=1!\n");
+                exit(1);
+            }
+            opts.stats = 1;
             break;
 
+        case 'b': // benchmark
+        case 'c': // compress
         case 'd': // decompress
-            // check for .huf extension
-            len = strlen(argv[2]);
-            if (strcmp(&argv[2][len - 4], ".huf") != 0) {
-                fprintf(stderr, "Must be an .huf archive!\n");
-                exit(0);
-            }
+            mode = c;
+            break;
 
-            huffman_decompress(fpt_in, argv[2], len);
+        case 'F': // benchmark report format
+            if (strcmp(optarg, "text") == 0) {
+                opts.format = BENCH_TEXT;
+            } else if (strcmp(optarg, "csv") == 0) {
+                opts.format = BENCH_CSV;
+            } else if (strcmp(optarg, "json") == 0) {
+                opts.format = BENCH_JSON;
+            } else {
+                fprintf(stderr, "Report format must be text, csv or json!\n");
+                exit(1);
+            }
             break;
 
-        default:
-            printf("Command line options\n");
-            printf("Options -----------------\n");
-            printf("  -c\t\tcompress file using Huffman codec\n");
-            printf("  -d\t\tdecompress file using Huffman codec\n");
-            exit(1);
-        }
+        case 'N': // benchmark iterations
+            opts.iterations = atoi(optarg);
+            if (opts.iterations < 1) {
+                fprintf(stderr, "Iteration count must be positive!\n");
+                exit(1);
+            }
+            break;
 
-    fclose(fpt_in);
-    return 0;
-}
+        case 'B': // block size
+            opts.block_size = parse_size(optarg);
+            if (opts.block_size < HUFF_MIN_BLOCK_SIZE || opts.block_size > HUFF_MAX_BLOCK_SIZE) {
+                fprintf(stderr, "Block size must be %dK to %dM!\n", HUFF_MIN_BLOCK_SIZE >> 10, HUFF_MAX_BLOCK_SIZE >> 20);
+                exit(1);
+            }
+            break;
 
-void huffman_compress(FILE *fpt_in, char *filename) {
-    int num_symbols, file_len;
+        case 'L': // code length limit
+            opts.max_len = atoi(optarg);
+            if (opts.max_len < HUFF_MIN_MAX_LEN || opts.max_len > HUFF_MAX_MAX_LEN) {
+                fprintf(stderr, "Code length limit must be %d to %d bits!\n", HUFF_MIN_MAX_LEN, HUFF_MAX_MAX_LEN);
+                exit(1);
+            }
+            break;
 
-    // open output file
-    FILE *fpt_out = fopen(strcat(filename, ".huf"), "wb");
+        case 'I': // interleaved bitstreams per block
+            opts.num_streams = atoi(optarg);
+            if (opts.num_streams != 1 && opts.num_streams != 4 && opts.num_streams != 8) {
+                fprintf(stderr, "Stream count must be 1, 4 or 8!\n");
+                exit(1);
+            }
+            break;
 
-    // construct a linked list
-    list_t *L = list_construct(compare, compare_freq);
+        case 'A': // adaptive coding
+            opts.mode = HUFF_MODE_ADAPTIVE;
+            break;
 
-    // read symbols from file, calculate frequencies of each symbol
-    calc_freq(fpt_in, L, &file_len);
-    num_symbols = list_size(L);
+        case 'O': // order-1 coding
+            opts.mode = HUFF_MODE_ORDER1;
+            break;
 
-    // sort list
-    list_sort(L);
+        case 'T': // coding threads
+            opts.num_threads = atoi(optarg);
+            if (opts.num_threads < 0) {
+                fprintf(stderr, "Thread count must not be negative!\n");
+                exit(1);
+            }
+            break;
 
-    // store frequency of each symbol
-    store_freq_table(fpt_out, L, file_len);
+        case 'v': // report statistics
+            opts.verbose = 1;
+            break;
 
-    // build tree
-    build_tree(L);
+        case 's': // write to standard output
+            opts.to_stdout = 1;
+            break;
 
-    // build varying length bit patterns using tree
-    huffman_codes_t *codes = build_codes(L, num_symbols);
+        default:
+            print_usage();
+            exit(1);
+        }
 
-    // output varying bit length patterns
-    huffman_encode(fpt_in, fpt_out, codes);
+    if (mode == 0 || optind != argc - 1) {
+        fprintf(stderr, "Usage: ./huff -flag <file>\n");
+        print_usage();
+        exit(0);
+    }
 
-    tree_destruct(L);
-    fclose(fpt_out);
-}
+    // open file to be compressed, "-" reads standard input and writes standard output
+    filename = argv[optind];
+    if (strcmp(filename, "-") == 0) {
+        fpt_in = stdin;
+        opts.to_stdout = 1;
+    } else {
+        fpt_in = fopen(filename, "rb");
+    }
 
-void huffman_decompress(FILE *fpt_in, char *filename, int len) {
-    int file_len;
+    if (fpt_in == NULL) {
+        fprintf(stderr, "Unable to open %s!\n", filename);
+        exit(1);
+    }
 
-    FILE *fpt_out = create_output_file(filename, len);
+    if (mode == 'b') {
+        huffman_bench(fpt_in, filename, &opts);
+    } else if (mode == 'c') {
+        if (opts.to_stdout && isatty(STDOUT_FILENO)) {
+            fprintf(stderr, "Will not write compressed data to a terminal!\n");
+            exit(1);
+        }
 
-    // read symbol frequency table from file
-    list_t *L = read_freq_table(fpt_in, &file_len);
+        huffman_compress(fpt_in, filename, &opts);
+    } else {
+        // check for .huf extension
+        len = strlen(filename);
+        if (fpt_in != stdin && (len < 4 || strcmp(&filename[len - 4], ".huf") != 0)) {
+            fprintf(stderr, "Must be an .huf archive!\n");
+            exit(0);
+        }
 
-    // build huffman codes from frequencies
-    build_tree(L);
+        huffman_decompress(fpt_in, filename, len, &opts);
+    }
 
-    // decode varying bit patterns from file and output symbols to new file
-    huffman_decode(fpt_in, fpt_out, L, file_len);
+    // output to standard output keeps the data stream clean
+    if (opts.stats) stats_report_json(opts.to_stdout && mode != 'b' ? stderr : stdout);
 
-    tree_destruct(L);
-    fclose(fpt_out);
+    if (fpt_in != stdin) fclose(fpt_in);
+    return 0;
 }
 
-// output Huffman codes to file
-void huffman_encode(FILE *fpt_in, FILE *fpt_out, huffman_codes_t *codes) {
-  int i, j, len, buffer_size = 0;
-  unsigned char sym_from_file, byte_to_write;
-  unsigned long int bit_buffer = 0;
-
-  fseek(fpt_in, 0, SEEK_SET);
-  while (!(feof(fpt_in))) {
-      i = 0;
-      fread(&sym_from_file, 1, 1, fpt_in);
-
-      while (codes[i].symbol != sym_from_file)
-          i++;
-
-      len = codes[i].code_len;
-
-      // set bits in buffer according to code
-      for (j = 0; j < len; j++) {
-          // little Endian - write from back to front
-          if (codes[i].code[j] == 1) {
-              // write codes starting at most significant bit
-              bit_buffer |= 1UL << (63 - (j + buffer_size));
-          }
-      }
-
-      buffer_size += codes[i].code_len;
-
-      // write out lowest byte of buffer
-      while (buffer_size >= 8) {
-          byte_to_write = bit_buffer >> 56;
-          fwrite(&byte_to_write, 1, 1, fpt_out);
-          bit_buffer <<= 8;
-          buffer_size -= 8;
-      }
-  }
-
-  // write out remaining odd bits
-  byte_to_write = bit_buffer >> 56;
-  fwrite(&byte_to_write, 1, 1, fpt_out);
+// prints command line options
+void print_usage(void) {
+    printf("Command line options\n");
+    printf("Options -----------------\n");
+    printf("  -c\t\tcompress file using Huffman codec\n");
+    printf("  -d\t\tdecompress file using Huffman codec\n");
+    printf("  -b\t\tbenchmark each coding stage on the file held in memory\n");
+    printf("  -B <size>\tbytes per block when compressing, K/M suffix allowed (default %dK)\n",
+           HUFF_DEFAULT_BLOCK_SIZE >> 10);
+    printf("  -L <bits>\tlimit code lengths when compressing (default %d)\n", HUFF_DEFAULT_MAX_LEN);
+    printf("  -I <streams>\tsplit each coded block into 1, 4 or 8 bitstreams decoded side by side (default %d)\n",
+           HUFF_DEFAULT_STREAMS);
+    printf("  -A\t\tcode with one adaptive Huffman tree instead of a table per block\n");
+    printf("  -O\t\tcode blocks order-1, with tables picked by the byte before each symbol, where it pays\n");
+    printf("  -N <runs>\ttimed runs when benchmarking (default 10)\n");
+    printf("  -F <format>\tbenchmark report as text, csv or json (default text)\n");
+    printf("  -T <threads>\tcode blocks on this many threads, 0 for one per CPU (default 1)\n");
+    printf("  -s\t\twrite to standard output instead of a file\n");
+    printf("  -v\t\treport compression statistics\n");
+    printf("  --stats=json\tprint time, cycles, bytes and allocations per coding stage (make STATS=1)\n");
+    printf("A file of - reads standard input and writes standard output\n");
 }
 
-// decode Huffman codes and output corresponding symbols to file
-void huffman_decode(FILE *fpt_in, FILE *fpt_out, list_t *list, int file_len) {
-  int ptr, bit, sym_count = 0;
-  unsigned char buf;
-  list_node_t *node;
-
-  // read in codes from compressed file
-  ptr = 7;
-  fread(&buf, 1, 1, fpt_in);
-  // find EOF manually
-  while (!(feof(fpt_in))) {
-      // start at root
-      node = list_iter_front(list);
-
-      // work through Huffman tree
-      while (node->left != NULL && node->right != NULL) {
-          // convert bit to int for easier comparisons
-          bit = buf & (1UL << ptr--) ? 1 : 0;
-
-          if (bit == 0)
-              node = node->left;
-          else
-              node = node->right;
-
-          if (ptr < 0) {
-              // read more when needed
-              fread(&buf, 1, 1, fpt_in);
-              ptr = 7;
-          }
-      }
-
-      if (sym_count < file_len) {
-          // output symbol for code
-          fwrite(&node->data_ptr->sym, 1, 1, fpt_out);
-          sym_count++;
-      }
-  }
+// parse a byte count with an optional K or M suffix
+size_t parse_size(const char *arg) {
+    char *end;
+    size_t size = strtoul(arg, &end, 10);
+
+    if (*end == 'K' || *end == 'k')
+        size <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        size <<= 20;
+    else if (*end != '\0')
+        size = 0;
+
+    return size;
 }
 
-// create "-recovered" file name
-FILE *create_output_file(char *filename, int len) {
-    // open renamed output file
-    char *new_name = (char *)calloc(len + 10, sizeof(char));
+void huffman_compress(FILE *fpt_in, char *filename, huff_options_t *opts) {
+    huff_cctx_t *cctx = huff_cctx_create();
+    unsigned char *out_buf = NULL, *dst;
+    uint64_t num_blocks, num_reused, num_raw, num_context;
+    uint64_t limit_cost, in_len, out_len;
+    map_file_t in, out;
+    FILE *fpt_out, *report = stdout;
+    char *out_name;
+    size_t cap, n;
 
-    // check for original extension
-    if (filename[len - 8] == '.') {
-        strncpy(new_name, filename, len - 8);
-        // append "-recovered" to name
-        strcpy(new_name + len - 8, "-recovered");
-        // append original extension
-        strncpy(new_name + len + 2, &filename[len - 8], 4);
+    // open output file
+    if (opts->to_stdout) {
+        out_name = strdup("stdout");
+        fpt_out = stdout;
+        report = stderr;
+    } else {
+        out_name = (char *)malloc(strlen(filename) + 5);
+        sprintf(out_name, "%s.huf", filename);
+        fpt_out = fopen(out_name, "w+b");
     }
-    // no extension (binary files)
-    else {
-        // append "-recovered" to name
-        strncpy(new_name, filename, len - 4);
-        strcpy(new_name + len - 4, "-recovered");
+
+    if (fpt_out == NULL) {
+        fprintf(stderr, "Unable to create %s!\n", out_name);
+        exit(1);
     }
 
-    return fopen(new_name, "wb");
-}
+    huff_cctx_set_max_len(cctx, opts->max_len);
+    huff_cctx_set_block_size(cctx, opts->block_size);
+    huff_cctx_set_threads(cctx, opts->num_threads);
+    huff_cctx_set_streams(cctx, opts->num_streams);
+    huff_cctx_set_mode(cctx, opts->mode);
+
+    map_open_input(&in, fpt_in);
 
-// calculate frequency of each symbol in a file and file length in bytes
-void calc_freq(FILE *fpt, list_t *list, int *file_len) {
-    *file_len = 0;
-    while (!(feof(fpt))) {
-        data_t *tmp_data = calloc(1, sizeof(data_t));
-        list_node_t *found_node = NULL;
-        data_t *found_data = NULL;
-        fread(&tmp_data->sym, 1, 1, fpt);
-        if (!(feof(fpt))) *file_len += 1;
-        tmp_data->freq = 0;
-
-        // tally frequency of each symbol
-        if ((found_node = list_elem_find(list, tmp_data)) != NULL) {
-            found_data = list_access(list, found_node);
-            found_data->freq++;
-            free(tmp_data);
+    if (in.data != NULL && !opts->to_stdout) {
+        // compress from the input mapping straight into the output mapping
+        cap = huff_compress_bound(in.len);
+        map_open_output(&out, fpt_out, cap);
+        if (out.data == NULL) out_buf = (unsigned char *)malloc(cap);
+        dst = map_reserve(&out, out_buf, cap);
+
+        n = huff_compress_cctx(cctx, dst, cap, in.data, in.len);
+        if (n == HUFF_ERROR || map_write(&out, dst, n) != 0 || map_close_output(&out) != 0) {
+            fprintf(stderr, "Unable to compress %s!\n", filename);
+            exit(1);
         }
-        // add symbol to list
-        else {
-            tmp_data->freq = 1;
-            list_insert(list, tmp_data, list_iter_back(list));
+
+        in_len = in.len;
+        out_len = n;
+    }
+    // pipes and standard output go through the streaming engine
+    else if (stream_compress(cctx, &in, fileno(fpt_out), &in_len, &out_len) != 0) {
+        fprintf(stderr, "Unable to compress %s!\n", filename);
+        exit(1);
+    }
+
+    if (opts->verbose) {
+        huff_cctx_stats(cctx, &num_blocks, &num_reused, &num_raw, &num_context, &limit_cost);
+        fprintf(report, "%s: %llu -> %llu bytes (%.2f%%)\n", out_name, (unsigned long long)in_len,
+                (unsigned long long)out_len, in_len ? 100.0 * out_len / in_len : 0.0);
+        if (opts->mode == HUFF_MODE_ADAPTIVE) {
+            fprintf(report, "%llu blocks: %llu coded adaptively, %llu stored\n", (unsigned long long)num_blocks,
+                    (unsigned long long)(num_blocks - num_raw), (unsigned long long)num_raw);
+        } else {
+            fprintf(report, "%llu blocks: %llu new tables, %llu reused, %llu stored", (unsigned long long)num_blocks,
+                    (unsigned long long)(num_blocks - num_reused - num_raw - num_context),
+                    (unsigned long long)num_reused, (unsigned long long)num_raw);
+            if (opts->mode == HUFF_MODE_ORDER1) fprintf(report, ", %llu order-1", (unsigned long long)num_context);
+            fprintf(report, "\n");
+            fprintf(report, "code lengths limited to %d bits: +%llu bytes (+%.3f%%)\n", opts->max_len,
+                    (unsigned long long)(limit_cost + 7) / 8, out_len ? 100.0 * limit_cost / 8 / out_len : 0.0);
         }
     }
+
+    map_close_input(&in);
+    huff_cctx_free(cctx);
+    free(out_buf);
+    free(out_name);
+    if (fpt_out != stdout) fclose(fpt_out);
 }
 
-// output a table of symbols and their frequencies to a file
-void store_freq_table(FILE *fpt, list_t *list, int file_len) {
-    int i, zero = 0;
-    data_t *data;
-    list_node_t *rover;
-    rover = list_iter_front(list);
-
-    for (i = 0; i < list_size(list); i++) {
-        data = list_access(list, rover);
-        fwrite(&data->sym, 1, 1, fpt);
-        fwrite(&data->freq, 1, 4, fpt);
-        rover = list_iter_next(rover);
+void huffman_decompress(FILE *fpt_in, char *filename, int len, huff_options_t *opts) {
+    huff_dctx_t *dctx = huff_dctx_create();
+    unsigned char *out_buf = NULL, *dst;
+    size_t raw_len = HUFF_ERROR, n;
+    map_file_t in, out;
+    FILE *fpt_out;
+
+    fpt_out = opts->to_stdout ? stdout : create_output_file(filename, len);
+    if (fpt_out == NULL) {
+        fprintf(stderr, "Unable to create output file!\n");
+        exit(1);
     }
 
-    // store entry with frequency 0 to denote end of header
-    fwrite(&zero, 1, 1, fpt);
-    fwrite(&zero, 1, 4, fpt);
-    // store file length
-    fwrite(&file_len, 1, 4, fpt); // limited to 4 GB
-}
+    huff_dctx_set_threads(dctx, opts->num_threads);
+    map_open_input(&in, fpt_in);
+    if (in.data != NULL && !opts->to_stdout) raw_len = huff_decompressed_size(in.data, in.len);
 
-// read in a table of symbols and their frequencies from a file
-list_t *read_freq_table(FILE *fpt, int *file_len) {
-    int freq;
-    unsigned char sym;
-    // construct a linked list
-    list_t *list = list_construct(compare, compare_freq);
-    // read in frequency table from file
-    fread(&sym, 1, 1, fpt);
-    fread(&freq, 1, 4, fpt);
-
-    while (freq != 0) {
-        data_t *tmp_data = calloc(1, sizeof(data_t));
-        tmp_data->sym = sym;
-        tmp_data->freq = freq;
-        list_insert(list, tmp_data, list_iter_back(list));
-        fread(&sym, 1, 1, fpt);
-        fread(&freq, 1, 4, fpt);
+    if (raw_len != HUFF_ERROR) {
+        // decode from the archive mapping straight into the output mapping
+        map_open_output(&out, fpt_out, raw_len);
+        if (out.data == NULL) out_buf = (unsigned char *)malloc(raw_len ? raw_len : 1);
+        dst = map_reserve(&out, out_buf, raw_len);
+
+        n = huff_decompress_dctx(dctx, dst, raw_len, in.data, in.len);
+        if (n != raw_len || map_write(&out, dst, n) != 0 || map_close_output(&out) != 0) {
+            fprintf(stderr, "Corrupt .huf archive!\n");
+            exit(1);
+        }
+    }
+    // pipes, standard output and archives without an index are decoded in order
+    else if (stream_decompress(dctx, &in, fileno(fpt_out)) != 0) {
+        fprintf(stderr, "Corrupt .huf archive!\n");
+        exit(1);
     }
-    fread(file_len, 1, 4, fpt);
 
-    list_sort(list);
-    return list;
+    map_close_input(&in);
+    huff_dctx_free(dctx);
+    free(out_buf);
+    if (fpt_out != stdout) fclose(fpt_out);
 }
 
-// build a Huffman tree from a linked list (converts list to tree)
-void build_tree(list_t *list) {
-    while (list_size(list) > 1) {
-        // combine two smallest frequencies into parent node
-        list_node_t *L_node = calloc(1, sizeof(list_node_t));
-        list_node_t *R_node = calloc(1, sizeof(list_node_t));
-        data_t *parent_data = calloc(1, sizeof(data_t));
-        L_node->left = list_iter_front(list)->left;
-        L_node->right = list_iter_front(list)->right;
-        L_node->data_ptr = list_remove(list, list_iter_front(list));
-        R_node->left = list_iter_front(list)->left;
-        R_node->right = list_iter_front(list)->right;
-        R_node->data_ptr = list_remove(list, list_iter_front(list));
-        parent_data->freq = L_node->data_ptr->freq + R_node->data_ptr->freq;
-        list_insert(list, parent_data, list_iter_front(list));
-        list_iter_front(list)->left = L_node;
-        list_iter_front(list)->right = R_node;
-        // resort frequencies (order stops mattering after combined)
-        list_sort(list);
+/******************************************************************************
+stream_compress:
+Purpose:      Compresses input of unknown length in bounded memory
+Parameters:   cctx - context with the settings to use
+              in - input, mapped or read to the end
+              fd_out - output
+              in_len, out_len - receive the bytes read and written
+Return:       0 on success, -1 on a read, write or memory error
+Notes:        mapped input is coded in place, other input is read in large
+              chunks; output is written a buffer at a time
+******************************************************************************/
+int stream_compress(huff_cctx_t *cctx, map_file_t *in, int fd_out, uint64_t *in_len, uint64_t *out_len) {
+    unsigned char *in_buf = NULL;
+    huff_in_buffer_t src;
+    huff_out_buffer_t dst;
+    pipe_writer_t pw;
+    size_t pending;
+    int status = 0;
+
+    *in_len = *out_len = 0;
+    if (pipe_writer_init(&pw, fd_out) != 0) return -1;
+
+    if (in->data == NULL) {
+        pipe_grow(fileno(in->fpt));
+        if ((in_buf = (unsigned char *)malloc(PIPE_BUF_SIZE)) == NULL) status = -1;
     }
-}
 
-// determine the Huffman code for each symbol in a Huffman tree
-huffman_codes_t *build_codes(list_t *list, int num_syms) {
-    huffman_codes_t *huff_codes = (huffman_codes_t *)calloc(num_syms, sizeof(huffman_codes_t));
-    int sym_code[NUM_SYMS - 1], idx = 0;
-    build_codes_rec(list->head, huff_codes, sym_code, 0, &idx);
-    return huff_codes;
-}
+    if (status == 0 && huff_compress_init(cctx) != 0) status = -1;
+
+    while (status == 0) {
+        src.pos = 0;
+        if (in->data != NULL) {
+            src.src = in->data + in->pos;
+            src.size = in->len - in->pos;
+            in->pos = in->len;
+        } else {
+            src.src = in_buf;
+            if (pipe_read(fileno(in->fpt), in_buf, PIPE_BUF_SIZE, &src.size) != 0) status = -1;
+        }
 
-// recursive auxiliary function to traverse tree
-void build_codes_rec(list_node_t *node, huffman_codes_t *huff_codes, int *code, int level, int *idx) {
-    int i;
+        if (status != 0 || src.size == 0) break;
+        *in_len += src.size;
 
-    // recurse through left nodes in tree
-    if (node->left != NULL) {
-        code[level] = 0;
-        build_codes_rec(node->left, huff_codes, code, level + 1, idx);
+        // blocks come out as soon as they fill
+        while (status == 0 && src.pos < src.size) {
+            dst.dst = pipe_writer_space(&pw, &dst.size);
+            dst.pos = 0;
+            if (huff_compress_update(cctx, &dst, &src) == HUFF_ERROR || pipe_writer_commit(&pw, dst.pos) != 0)
+                status = -1;
+            *out_len += dst.pos;
+        }
     }
 
-    // recurse through right nodes in tree
-    if (node->right != NULL) {
-        code[level] = 1;
-        build_codes_rec(node->right, huff_codes, code, level + 1, idx);
+    // last block, end marker and index
+    do {
+        dst.dst = pipe_writer_space(&pw, &dst.size);
+        dst.pos = 0;
+        if (status != 0 || (pending = huff_compress_end(cctx, &dst)) == HUFF_ERROR ||
+                pipe_writer_commit(&pw, dst.pos) != 0)
+            status = -1;
+        *out_len += dst.pos;
+    } while (status == 0 && pending > 0);
+
+    if (pipe_writer_end(&pw) != 0) status = -1;
+
+    free(in_buf);
+    return status;
+}
+
+/******************************************************************************
+stream_decompress:
+Purpose:      Decompresses an archive read in order, in bounded memory
+Parameters:   dctx - context
+              in - archive, mapped or read to the end
+              fd_out - output
+Return:       0 on success, -1 if the archive is corrupt or cut short or on a
+              read or write error
+******************************************************************************/
+int stream_decompress(huff_dctx_t *dctx, map_file_t *in, int fd_out) {
+    unsigned char *in_buf = NULL;
+    huff_in_buffer_t src;
+    huff_out_buffer_t dst;
+    pipe_writer_t pw;
+    size_t pending = 0;
+    int status = 0;
+
+    if (pipe_writer_init(&pw, fd_out) != 0) return -1;
+
+    if (in->data == NULL) {
+        pipe_grow(fileno(in->fpt));
+        if ((in_buf = (unsigned char *)malloc(PIPE_BUF_SIZE)) == NULL) status = -1;
     }
 
-    // root node
-    if (node->right == NULL && node->left == NULL) {
-        // store symbol and code in struct
-        huff_codes[*idx].symbol = node->data_ptr->sym;
-        huff_codes[*idx].code = (unsigned char *)calloc(level, 1);
+    huff_decompress_init(dctx);
+
+    while (status == 0) {
+        src.pos = 0;
+        if (in->data != NULL) {
+            src.src = in->data + in->pos;
+            src.size = in->len - in->pos;
+            in->pos = in->len;
+        } else {
+            src.src = in_buf;
+            if (pipe_read(fileno(in->fpt), in_buf, PIPE_BUF_SIZE, &src.size) != 0) status = -1;
+        }
+
+        if (status != 0 || src.size == 0) break;
 
-        for (i = 0; i < level; i++) {
-            huff_codes[*idx].code[i] = code[i];
+        while (status == 0 && src.pos < src.size) {
+            dst.dst = pipe_writer_space(&pw, &dst.size);
+            dst.pos = 0;
+            if ((pending = huff_decompress_update(dctx, &dst, &src)) == HUFF_ERROR ||
+                    pipe_writer_commit(&pw, dst.pos) != 0)
+                status = -1;
         }
+    }
 
-        huff_codes[*idx].code_len = level;
-        *idx += 1;
+    // hand over what the last block left behind
+    while (status == 0 && pending > 0) {
+        dst.dst = pipe_writer_space(&pw, &dst.size);
+        dst.pos = 0;
+        pending = huff_decompress_flush(dctx, &dst);
+        if (pipe_writer_commit(&pw, dst.pos) != 0) status = -1;
     }
+
+    if (huff_decompress_end(dctx) != 0) status = -1;
+    if (pipe_writer_end(&pw) != 0) status = -1;
+
+    free(in_buf);
+    return status;
+}
+
+/******************************************************************************
+huffman_bench:
+Purpose:      Times each coding stage on a file and checks the round trip
+Parameters:   fpt_in - input, read into memory once
+              filename - name used in the report
+              opts - block size, code length limit, streams, mode and number
+                     of runs
+Return:       void, exits if the decoded data does not match the input
+Notes:        runs on one thread so stage times add up to the whole
+******************************************************************************/
+void huffman_bench(FILE *fpt_in, char *filename, huff_options_t *opts) {
+    bench_result_t res;
+    unsigned char *buf;
+    size_t len;
+
+    if ((buf = read_input(fpt_in, &len)) == NULL) {
+        fprintf(stderr, "Unable to read %s!\n", filename);
+        exit(1);
+    }
+
+    if (bench_run(buf, len, opts->block_size, opts->max_len, opts->num_streams, opts->mode, opts->iterations,
+                  &res) != 0) {
+        fprintf(stderr, "Round trip failed on %s!\n", filename);
+        exit(1);
+    }
+
+    bench_report(stdout, filename, &res, opts->format);
+    if (opts->format == BENCH_TEXT) printf("  round trip OK\n");
+    free(buf);
 }
 
-// comparison function for linked list
-int compare(const data_t *a, const data_t *b) {
-    if (a->sym < b->sym)
-        return 1;
-    else if (a->sym > b->sym)
-        return -1;
-    else
-        return 0;
+// read a whole input into memory, NULL on a read or memory error
+unsigned char *read_input(FILE *fpt, size_t *len) {
+    unsigned char *buf = NULL, *new_buf;
+    size_t cap = 0, n;
+
+    *len = 0;
+    do {
+        if (cap - *len < PIPE_BUF_SIZE) {
+            cap = cap ? 2 * cap : 4 * PIPE_BUF_SIZE;
+            if ((new_buf = (unsigned char *)realloc(buf, cap)) == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = new_buf;
+        }
+
+        if (pipe_read(fileno(fpt), buf + *len, cap - *len, &n) != 0) {
+            free(buf);
+            return NULL;
+        }
+        *len += n;
+    } while (n > 0);
+
+    return buf;
 }
 
-// comparison function for linked list sorting algorithms
-int compare_freq(const data_t *a, const data_t *b) {
-    if (a->freq < b->freq)
-        return 1;
-    else if (a->freq > b->freq)
-        return -1;
-    else { // sort ties by alphabetical order
-        if (a->sym < b->sym)
-            return 1;
-        else if (a->sym > b->sym)
-            return -1;
-        else
-            return 0;
+// create "-recovered" file name
+FILE *create_output_file(char *filename, int len) {
+    // open renamed output file
+    char *new_name = (char *)calloc(len + 10, sizeof(char));
+
+    // check for original extension, only names long enough to hold one
+    if (len >= 8 && filename[len - 8] == '.') {
+        strncpy(new_name, filename, len - 8);
+        // append "-recovered" to name
+        strcpy(new_name + len - 8, "-recovered");
+        // append original extension
+        strncpy(new_name + len + 2, &filename[len - 8], 4);
     }
+    // no extension (binary files)
+    else {
+        // append "-recovered" to name
+        strncpy(new_name, filename, len - 4);
+        strcpy(new_name + len - 4, "-recovered");
+    }
+
+    return fopen(new_name, "w+b");
 }
 
 // prints linked list
 void list_debug_print(list_t *L) {
     list_node_t *n = list_iter_front(L);
     data_t *d = list_access(L, n);
-    printf("[%c] - %d\n", d->sym, d->freq);
+    printf("[%c] - %llu\n", d->sym, (unsigned long long)d->freq);
 
     while (list_iter_next(n) != NULL) {
         n = list_iter_next(n);
         d = list_access(L, n);
-        printf("[%c] - %d\n", d->sym, d->freq);
+        printf("[%c] - %llu\n", d->sym, (unsigned long long)d->freq);
     }
 }
 
@@ -424,19 +613,21 @@ void ugly_print(list_node_t *N, int level) {
 
     for (i = 0; i < level; i++) printf("     "); /* 5 spaces */
 
-    printf("%5d\n", N->data_ptr->freq);
+    printf("%5llu\n", (unsigned long long)N->data_ptr->freq);
     ugly_print(N->left, level + 1);
 }
 
 // prints symbols and their corresponding Huffman codes
-void debug_print_huffman_codes(huffman_codes_t *codes, int num_symbols) {
+void debug_print_huffman_codes(huffman_codes_t *codes) {
     int i, j;
 
-    for (i = 0; i < num_symbols; i++) {
-        printf("[%c]\t", codes[i].symbol);
+    for (i = 0; i < NUM_SYMS; i++) {
+        if (codes[i].code_len == 0) continue;
+
+        printf("[%c]\t", i);
 
-        for (j = 0; j < codes[i].code_len; j++) {
-            printf("%d", codes[i].code[j]);
+        for (j = codes[i].code_len - 1; j >= 0; j--) {
+            printf("%d", (int)(codes[i].code >> j) & 1);
         }
 
         printf("\n");
@@ -0,0 +1,326 @@
+//
+//  huffgen.c
+//  Synthetic input generator for benchmarking the Huffman codec
+//  writes reproducible data with a chosen symbol distribution
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define GEN_CHUNK (1 << 20)         // bytes generated per write
+#define GEN_TABLE_BITS 16           // resolution of the sampling table
+#define GEN_TABLE_SIZE (1 << GEN_TABLE_BITS)
+#define GEN_VOCAB 4096              // words in the text vocabulary
+#define GEN_IMAGE_WIDTH 1024        // pixels per row of the image
+
+// generator state
+typedef struct gen_tag {
+    uint64_t rng;                   // xorshift state
+    unsigned char table[GEN_TABLE_SIZE];   // symbols in proportion to their probability
+    uint64_t pos;                   // bytes generated so far
+    unsigned char *vocab;           // text: words back to back
+    int *vocab_off;                 // text: start of each word
+    unsigned char token[16];        // text: word and separator being written
+    int token_len, token_pos;
+    int column;                     // text: characters on the current line
+} gen_t;
+
+typedef void (*gen_fill_t)(gen_t *, unsigned char *, size_t);
+
+typedef struct gen_dist_tag {
+    const char *name;
+    gen_fill_t fill;
+    const char *description;
+} gen_dist_t;
+
+// prototypes for functions used in huffgen.c only
+uint64_t gen_next(gen_t *);
+void gen_table(gen_t *, const double *, int);
+void gen_setup(gen_t *, const char *);
+void gen_fill_table(gen_t *, unsigned char *, size_t);
+void gen_fill_random(gen_t *, unsigned char *, size_t);
+void gen_fill_single(gen_t *, unsigned char *, size_t);
+void gen_fill_text(gen_t *, unsigned char *, size_t);
+void gen_fill_image(gen_t *, unsigned char *, size_t);
+uint64_t parse_size(const char *);
+void print_usage(void);
+
+const gen_dist_t dists[] = {
+    {"uniform", gen_fill_table, "64 symbols, equally likely"},
+    {"zipf", gen_fill_table, "256 symbols, the k-th with probability proportional to 1/k"},
+    {"geometric", gen_fill_table, "256 symbols, each half as likely as the one before"},
+    {"single", gen_fill_single, "one symbol repeated"},
+    {"two", gen_fill_table, "two symbols, 3:1"},
+    {"random", gen_fill_random, "random bytes, incompressible"},
+    {"text", gen_fill_text, "words of a Zipf vocabulary with spaces and line breaks"},
+    {"image", gen_fill_image, "8-bit RGB gradients with noise, PPM header first"},
+};
+
+#define NUM_DISTS (int)(sizeof(dists) / sizeof(dists[0]))
+
+int main(int argc, char **argv) {
+    unsigned char *buf;
+    const gen_dist_t *dist = NULL;
+    uint64_t size, left;
+    size_t n;
+    gen_t *gen;
+    int i;
+
+    if (argc < 3 || argc > 4) {
+        print_usage();
+        exit(1);
+    }
+
+    for (i = 0; i < NUM_DISTS; i++) {
+        if (strcmp(argv[1], dists[i].name) == 0) dist = &dists[i];
+    }
+
+    size = parse_size(argv[2]);
+    if (dist == NULL || size == 0) {
+        print_usage();
+        exit(1);
+    }
+
+    buf = (unsigned char *)malloc(GEN_CHUNK);
+    gen = (gen_t *)calloc(1, sizeof(gen_t));
+    if (buf == NULL || gen == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(1);
+    }
+
+    // same seed, same output
+    gen->rng = (argc == 4 ? strtoull(argv[3], NULL, 10) : 1) * 0x9e3779b97f4a7c15ULL | 1;
+    gen_setup(gen, dist->name);
+
+    for (left = size; left > 0; left -= n) {
+        n = left < GEN_CHUNK ? left : GEN_CHUNK;
+        dist->fill(gen, buf, n);
+        gen->pos += n;
+        if (fwrite(buf, 1, n, stdout) != n) {
+            fprintf(stderr, "Unable to write output!\n");
+            exit(1);
+        }
+    }
+
+    free(gen->vocab);
+    free(gen->vocab_off);
+    free(gen);
+    free(buf);
+    return 0;
+}
+
+// prints command line options
+void print_usage(void) {
+    int i;
+
+    printf("Usage: ./huffgen <distribution> <size> [seed]\n");
+    printf("Writes size bytes to standard output, K/M/G suffix allowed\n");
+    printf("Distributions -----------\n");
+    for (i = 0; i < NUM_DISTS; i++) printf("  %-10s\t%s\n", dists[i].name, dists[i].description);
+}
+
+// parse a byte count with an optional K, M or G suffix
+uint64_t parse_size(const char *arg) {
+    char *end;
+    uint64_t size = strtoull(arg, &end, 10);
+
+    if (*end == 'K' || *end == 'k')
+        size <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        size <<= 20;
+    else if (*end == 'G' || *end == 'g')
+        size <<= 30;
+    else if (*end != '\0')
+        size = 0;
+
+    return size;
+}
+
+// xorshift64* pseudo-random numbers, the same sequence for the same seed
+uint64_t gen_next(gen_t *gen) {
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 0x2545f4914f6cdd1dULL;
+}
+
+/******************************************************************************
+gen_table:
+Purpose:      Fills the sampling table so each symbol takes a share of
+              entries equal to its probability
+Parameters:   gen - generator
+              weight - relative weight of symbols 0 to n - 1
+              n - number of symbols
+Return:       void
+Notes:        every symbol gets at least one entry, so the rare symbols of
+              skewed distributions still appear
+******************************************************************************/
+void gen_table(gen_t *gen, const double *weight, int n) {
+    double total = 0.0, cum = 0.0;
+    int i, start = 0, end;
+
+    for (i = 0; i < n; i++) total += weight[i];
+
+    for (i = 0; i < n; i++) {
+        cum += weight[i];
+        end = (int)(cum / total * GEN_TABLE_SIZE + 0.5);
+        if (end <= start) end = start + 1;
+        if (end > GEN_TABLE_SIZE - (n - 1 - i)) end = GEN_TABLE_SIZE - (n - 1 - i);
+        memset(gen->table + start, i, end - start);
+        start = end;
+    }
+}
+
+// prepare the tables a distribution samples from
+void gen_setup(gen_t *gen, const char *name) {
+    static const double letter[26] = {8.2, 1.5, 2.8, 4.3, 12.7, 2.2, 2.0, 6.1, 7.0, 0.2, 0.8, 4.0, 2.4,
+                                      6.7, 7.5, 1.9, 0.1, 6.0, 6.3, 9.1, 2.8, 1.0, 2.4, 0.2, 2.0, 0.1};
+    double weight[256];
+    int i, j, len;
+
+    if (strcmp(name, "uniform") == 0) {
+        for (i = 0; i < 64; i++) weight[i] = 1.0;
+        gen_table(gen, weight, 64);
+    } else if (strcmp(name, "zipf") == 0) {
+        for (i = 0; i < 256; i++) weight[i] = 1.0 / (i + 1);
+        gen_table(gen, weight, 256);
+    } else if (strcmp(name, "geometric") == 0) {
+        for (i = 0; i < 256; i++) weight[i] = ldexp(1.0, -i);
+        gen_table(gen, weight, 256);
+    } else if (strcmp(name, "two") == 0) {
+        weight[0] = 3.0;
+        weight[1] = 1.0;
+        gen_table(gen, weight, 2);
+    } else if (strcmp(name, "text") == 0) {
+        // random words drawn with English letter frequencies
+        gen_table(gen, letter, 26);
+
+        gen->vocab = (unsigned char *)malloc(GEN_VOCAB * 10);
+        gen->vocab_off = (int *)malloc((GEN_VOCAB + 1) * sizeof(int));
+        if (gen->vocab == NULL || gen->vocab_off == NULL) {
+            fprintf(stderr, "Out of memory!\n");
+            exit(1);
+        }
+
+        // common words are short
+        gen->vocab_off[0] = 0;
+        for (i = 0; i < GEN_VOCAB; i++) {
+            len = 1 + gen_next(gen) % (i < 64 ? 4 : 10);
+            for (j = 0; j < len; j++) gen->vocab[gen->vocab_off[i] + j] = 'a' + gen->table[gen_next(gen) >> 48];
+            gen->vocab_off[i + 1] = gen->vocab_off[i] + len;
+        }
+    }
+}
+
+// draw symbols from the sampling table
+void gen_fill_table(gen_t *gen, unsigned char *buf, size_t len) {
+    uint64_t r;
+    size_t i;
+
+    for (i = 0; i + 4 <= len; i += 4) {
+        r = gen_next(gen);
+        buf[i] = gen->table[r & (GEN_TABLE_SIZE - 1)];
+        buf[i + 1] = gen->table[r >> 16 & (GEN_TABLE_SIZE - 1)];
+        buf[i + 2] = gen->table[r >> 32 & (GEN_TABLE_SIZE - 1)];
+        buf[i + 3] = gen->table[r >> 48];
+    }
+
+    for (; i < len; i++) buf[i] = gen->table[gen_next(gen) >> 48];
+}
+
+// random bytes straight from the generator
+void gen_fill_random(gen_t *gen, unsigned char *buf, size_t len) {
+    uint64_t r;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        r = gen_next(gen);
+        memcpy(buf + i, &r, 8);
+    }
+
+    for (; i < len; i++) buf[i] = gen_next(gen) >> 56;
+}
+
+// one symbol throughout
+void gen_fill_single(gen_t *gen, unsigned char *buf, size_t len) {
+    memset(buf, 'a', len);
+}
+
+/******************************************************************************
+gen_fill_text:
+Purpose:      Writes words separated by spaces, with occasional punctuation
+              and line breaks
+Parameters:   gen - generator, a word cut off by the end of the previous
+                    buffer is finished first
+              buf, len - output
+Return:       void
+Notes:        word k of the vocabulary is drawn with probability about
+              1/k, like word frequencies in natural language
+******************************************************************************/
+void gen_fill_text(gen_t *gen, unsigned char *buf, size_t len) {
+    size_t i = 0;
+    uint64_t r;
+    int word;
+
+    while (i < len) {
+        if (gen->token_pos == gen->token_len) {
+            // inverse of the Zipf cumulative distribution, approximately
+            r = gen_next(gen);
+            word = (int)exp((double)(r >> 11) / (1ULL << 53) * log((double)GEN_VOCAB));
+            if (word >= GEN_VOCAB) word = GEN_VOCAB - 1;
+            gen->token_len = gen->vocab_off[word + 1] - gen->vocab_off[word];
+            memcpy(gen->token, gen->vocab + gen->vocab_off[word], gen->token_len);
+
+            // separator after the word
+            r = gen_next(gen);
+            if (r % 32 == 0) gen->token[gen->token_len++] = r % 128 == 0 ? '.' : ',';
+            gen->column += gen->token_len + 1;
+            if (gen->column > 72) {
+                gen->token[gen->token_len++] = '\n';
+                gen->column = 0;
+            } else {
+                gen->token[gen->token_len++] = ' ';
+            }
+            gen->token_pos = 0;
+        }
+
+        buf[i++] = gen->token[gen->token_pos++];
+    }
+}
+
+/******************************************************************************
+gen_fill_image:
+Purpose:      Writes an RGB image whose channels vary smoothly across the
+              picture in flat bands, with noise on some samples
+Parameters:   gen - generator, gen->pos gives the place in the image
+              buf, len - output
+Return:       void
+Notes:        the stream starts with a PPM header for a 1024 pixel wide
+              image; its height is nominal and the data ends wherever the
+              requested size does
+******************************************************************************/
+void gen_fill_image(gen_t *gen, unsigned char *buf, size_t len) {
+    char header[64];
+    int header_len = sprintf(header, "P6\n%d %d\n255\n", GEN_IMAGE_WIDTH, 1 << 20);
+    uint64_t pos, pixel, r;
+    size_t i = 0;
+    int x, y, c, v;
+
+    for (pos = gen->pos; pos < (uint64_t)header_len && i < len; pos++) buf[i++] = header[pos];
+
+    for (; i < len; i++, pos++) {
+        pixel = (pos - header_len) / 3;
+        c = (pos - header_len) % 3;
+        x = pixel % GEN_IMAGE_WIDTH;
+        y = pixel / GEN_IMAGE_WIDTH;
+
+        // posterized gradient with sparse noise, a histogram peaked like a photo's
+        v = 128 + (int)(100.0 * sin(x * (0.005 + 0.003 * c) + y * 0.004) * cos(y * 0.002 - c)) / 8 * 8;
+        r = gen_next(gen);
+        if (r % 8 == 0) v += (int)(r >> 8 & 7) - 4;
+        buf[i] = v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+}
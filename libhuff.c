@@ -0,0 +1,805 @@
+//
+//  libhuff.c
+//  API for in-memory Huffman compression of .huf archives
+//  buffer to buffer calls with reusable contexts, no files involved
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "libhuff.h"
+#include "block.h"
+#include "mapio.h"
+#include "parallel.h"
+
+// a stream keeps at most this many index entries, longer streams end without an index
+#define STREAM_MAX_INDEX (1 << 20)
+
+// stream states
+#define STREAM_IDLE 0
+#define STREAM_RUNNING 1
+#define STREAM_ENDED 2              // compression: end written, decompression: end read
+#define STREAM_ERROR 3
+
+// decompression stream, next part of the archive expected
+#define PART_FILE_HEADER 0
+#define PART_BLOCK_HEADER 1
+#define PART_PAYLOAD 2
+
+// bytes coded but not yet handed to the caller
+typedef struct stream_pending_tag {
+    const unsigned char *buf;
+    size_t len;
+    size_t pos;
+} stream_pending_t;
+
+struct huff_cctx_tag {
+    int max_len;                        // code length limit
+    size_t block_size;                  // bytes of input per block
+    int num_threads;
+    int num_streams;                    // bitstreams per coded block
+    int mode;                           // HUFF_MODE_STATIC, HUFF_MODE_ADAPTIVE or HUFF_MODE_ORDER1
+    block_encoder_t enc;                // tables and statistics of the last call
+    block_index_t idx;
+    unsigned char *out_buf;             // block coded when dst has no room for slack
+    unsigned char *index_buf;           // stored index
+    size_t index_cap;
+    // streaming state
+    int state;
+    unsigned char *in_buf;              // partial block
+    size_t in_len;
+    stream_pending_t pending;
+};
+
+struct huff_dctx_tag {
+    int num_threads;
+    block_decoder_t dec;                // lookup tables, kept between calls
+    block_index_t idx;
+    // streaming state
+    int state;
+    int part;
+    unsigned char header[BLOCK_HEADER]; // partial file or block header
+    size_t header_len;
+    size_t block_size;
+    int flags;                          // header of the current block
+    size_t raw_len, comp_len;
+    unsigned char *in_buf;              // partial payload
+    size_t in_len;
+    unsigned char *out_buf;             // block decoded when dst has no room
+    stream_pending_t pending;
+};
+
+// prototypes for private functions used in libhuff.c only
+int compress_archive(huff_cctx_t *, map_file_t *, map_file_t *);
+int decompress_archive(huff_dctx_t *, map_file_t *, map_file_t *);
+int load_index(block_index_t *, const map_file_t *, size_t);
+int stream_buffers(huff_cctx_t *);
+int block_mode(int);
+int stream_emit_block(huff_cctx_t *, huff_out_buffer_t *, const unsigned char *, size_t);
+size_t stream_drain(stream_pending_t *, huff_out_buffer_t *);
+int stream_decode_block(huff_dctx_t *, huff_out_buffer_t *, const unsigned char *);
+size_t stream_gather(unsigned char *, size_t *, size_t, huff_in_buffer_t *);
+
+/* Returns the most bytes an archive of src_len bytes can take, for any block
+ * size
+ */
+size_t huff_compress_bound(size_t src_len) {
+    size_t num_blocks = (src_len + BLOCK_MIN_SIZE - 1) / BLOCK_MIN_SIZE;
+
+    // a block never takes more than its header plus its bytes stored raw
+    return BLOCK_FILE_HEADER + num_blocks * (BLOCK_HEADER + BLOCK_INDEX_ENTRY) + src_len + 1 + BLOCK_FOOTER;
+}
+
+/* Compresses src into dst with default settings
+ *
+ * Return: bytes stored, HUFF_ERROR if dst is too small or out of memory
+ */
+size_t huff_compress(void *dst, size_t dst_cap, const void *src, size_t src_len) {
+    huff_cctx_t *cctx = huff_cctx_create();
+    size_t n;
+
+    if (cctx == NULL) return HUFF_ERROR;
+
+    n = huff_compress_cctx(cctx, dst, dst_cap, src, src_len);
+    huff_cctx_free(cctx);
+    return n;
+}
+
+/* Decompresses an archive in src into dst
+ *
+ * Return: bytes stored, HUFF_ERROR if dst is too small or src is corrupt
+ */
+size_t huff_decompress(void *dst, size_t dst_cap, const void *src, size_t src_len) {
+    huff_dctx_t *dctx = huff_dctx_create();
+    size_t n;
+
+    if (dctx == NULL) return HUFF_ERROR;
+
+    n = huff_decompress_dctx(dctx, dst, dst_cap, src, src_len);
+    huff_dctx_free(dctx);
+    return n;
+}
+
+/******************************************************************************
+huff_decompressed_size:
+Purpose:      Reads the original size of an archive from its block index
+Parameters:   src, src_len - the whole archive
+Return:       bytes the archive decompresses to, HUFF_ERROR if src is not an
+              archive or has no index
+******************************************************************************/
+size_t huff_decompressed_size(const void *src, size_t src_len) {
+    size_t block_size, raw_len = HUFF_ERROR;
+    block_index_t idx;
+    map_file_t in;
+    int mode;
+
+    map_memory(&in, src, src_len);
+    if (src_len < BLOCK_FILE_HEADER || block_read_file_header(in.data, &block_size, &mode) != 0)
+        return HUFF_ERROR;
+
+    block_index_init(&idx);
+    if (load_index(&idx, &in, block_size) == 0 && idx.raw_len < HUFF_ERROR) raw_len = idx.raw_len;
+
+    block_index_free(&idx);
+    return raw_len;
+}
+
+/* Creates a compression context with default settings
+ *
+ * Return: the context, NULL if out of memory
+ */
+huff_cctx_t *huff_cctx_create(void) {
+    huff_cctx_t *cctx = (huff_cctx_t *)calloc(1, sizeof(huff_cctx_t));
+
+    if (cctx == NULL) return NULL;
+
+    cctx->max_len = CODES_DEFAULT_LIMIT;
+    cctx->block_size = BLOCK_DEFAULT_SIZE;
+    cctx->num_threads = 1;
+    cctx->num_streams = HUFF_DEFAULT_STREAMS;
+    block_index_init(&cctx->idx);
+    return cctx;
+}
+
+void huff_cctx_free(huff_cctx_t *cctx) {
+    if (cctx == NULL) return;
+
+    block_encoder_free(&cctx->enc);
+    block_index_free(&cctx->idx);
+    free(cctx->out_buf);
+    free(cctx->index_buf);
+    free(cctx->in_buf);
+    free(cctx);
+}
+
+/* Sets the code length limit, 0 on success or -1 if out of range
+ */
+int huff_cctx_set_max_len(huff_cctx_t *cctx, int max_len) {
+    if (max_len < HUFF_MIN_MAX_LEN || max_len > CODES_MAX_LEN) return -1;
+
+    cctx->max_len = max_len;
+    return 0;
+}
+
+/* Sets the bytes of input per block, 0 on success or -1 if out of range
+ */
+int huff_cctx_set_block_size(huff_cctx_t *cctx, size_t block_size) {
+    if (block_size < BLOCK_MIN_SIZE || block_size > BLOCK_MAX_SIZE || cctx->state == STREAM_RUNNING) return -1;
+
+    // scratch is sized for the block size
+    if (block_size != cctx->block_size) {
+        free(cctx->out_buf);
+        free(cctx->in_buf);
+        cctx->out_buf = cctx->in_buf = NULL;
+    }
+
+    cctx->block_size = block_size;
+    return 0;
+}
+
+/* Sets the threads blocks are coded on, 0 for one per CPU
+ */
+int huff_cctx_set_threads(huff_cctx_t *cctx, int num_threads) {
+    if (num_threads < 0) return -1;
+
+    cctx->num_threads = parallel_threads(num_threads);
+    return 0;
+}
+
+/* Sets the interleaved bitstreams each coded block is split into, 1, 4 or 8
+ *
+ * More streams let the decoder work on several codes at once, at a cost of
+ * a few bytes per block. Archives with more than one stream per block need
+ * a decoder that knows about substreams.
+ */
+int huff_cctx_set_streams(huff_cctx_t *cctx, int num_streams) {
+    if (num_streams != 1 && num_streams != 4 && num_streams != 8) return -1;
+
+    cctx->num_streams = num_streams;
+    return 0;
+}
+
+/* Sets how archives are coded, HUFF_MODE_STATIC, HUFF_MODE_ADAPTIVE or
+ * HUFF_MODE_ORDER1
+ *
+ * Adaptive archives send no tables, which pays off on small blocks and
+ * flushed streams, but are coded one symbol at a time on one thread and
+ * ignore the code length limit and stream count. Order-1 archives code a
+ * block with up to 16 tables, picked by the byte before each symbol, when
+ * that beats one table; split into streams, each stream of such a block
+ * starts as if after a 0 byte.
+ */
+int huff_cctx_set_mode(huff_cctx_t *cctx, int mode) {
+    if ((mode != HUFF_MODE_STATIC && mode != HUFF_MODE_ADAPTIVE && mode != HUFF_MODE_ORDER1) ||
+            cctx->state == STREAM_RUNNING)
+        return -1;
+
+    cctx->mode = mode;
+    return 0;
+}
+
+// encoder mode for a HUFF_MODE_*
+int block_mode(int mode) {
+    if (mode == HUFF_MODE_ADAPTIVE) return BLOCK_ADAPTIVE;
+    if (mode == HUFF_MODE_ORDER1) return BLOCK_ORDER1;
+    return BLOCK_STATIC;
+}
+
+/******************************************************************************
+huff_compress_cctx:
+Purpose:      Compresses src into dst as a .huf archive
+Parameters:   cctx - context, its settings are used and its memory reused
+              dst, dst_cap - output buffer, huff_compress_bound(src_len)
+                             bytes are always enough
+              src, src_len - input
+Return:       bytes stored, HUFF_ERROR if dst is too small or out of memory
+Notes:        the archive is the same for any number of threads
+******************************************************************************/
+size_t huff_compress_cctx(huff_cctx_t *cctx, void *dst, size_t dst_cap, const void *src, size_t src_len) {
+    map_file_t in, out;
+
+    map_memory(&in, src, src_len);
+    map_memory(&out, dst, dst_cap);
+
+    if (compress_archive(cctx, &in, &out) != 0) return HUFF_ERROR;
+    return out.pos;
+}
+
+/******************************************************************************
+huff_compress_init:
+Purpose:      Starts compressing a stream with the settings of a context
+Parameters:   cctx - context, any stream it was coding is abandoned
+Return:       0 on success, -1 if out of memory
+Notes:        the stream is fed with huff_compress_update and finished with
+              huff_compress_end; memory use depends on the block size only,
+              not on the length of the stream
+******************************************************************************/
+int huff_compress_init(huff_cctx_t *cctx) {
+    if (stream_buffers(cctx) != 0) return -1;
+
+    block_encoder_init(&cctx->enc, cctx->max_len, cctx->num_streams, block_mode(cctx->mode));
+    block_index_reset(&cctx->idx);
+
+    // file header goes out first
+    block_write_file_header(cctx->out_buf, cctx->block_size, cctx->enc.mode);
+    cctx->pending.buf = cctx->out_buf;
+    cctx->pending.len = BLOCK_FILE_HEADER;
+    cctx->pending.pos = 0;
+
+    cctx->in_len = 0;
+    cctx->state = STREAM_RUNNING;
+    return 0;
+}
+
+/******************************************************************************
+huff_compress_update:
+Purpose:      Feeds input to a compression stream
+Parameters:   cctx - context started by huff_compress_init
+              out - receives the blocks coded so far
+              in - input, consumed up to in->pos
+Return:       bytes coded but waiting for room in out, HUFF_ERROR if the
+              stream is not running
+Notes:        every full block is coded as soon as it is complete; input is
+              only left unconsumed when out is full
+******************************************************************************/
+size_t huff_compress_update(huff_cctx_t *cctx, huff_out_buffer_t *out, huff_in_buffer_t *in) {
+    const unsigned char *src;
+    size_t pending;
+
+    if (cctx->state != STREAM_RUNNING) return HUFF_ERROR;
+
+    while ((pending = stream_drain(&cctx->pending, out)) == 0 && in->pos < in->size) {
+        // code whole blocks straight from the input when nothing is staged
+        if (cctx->in_len == 0 && in->size - in->pos >= cctx->block_size) {
+            src = (const unsigned char *)in->src + in->pos;
+            in->pos += cctx->block_size;
+        } else {
+            stream_gather(cctx->in_buf, &cctx->in_len, cctx->block_size, in);
+            if (cctx->in_len < cctx->block_size) break;
+
+            src = cctx->in_buf;
+            cctx->in_len = 0;
+        }
+
+        if (stream_emit_block(cctx, out, src, cctx->block_size) != 0) return HUFF_ERROR;
+    }
+
+    return pending;
+}
+
+/******************************************************************************
+huff_compress_flush:
+Purpose:      Codes the input staged so far as a block of its own
+Parameters:   cctx - context started by huff_compress_init
+              out - receives the blocks
+Return:       bytes waiting for room in out, call again until 0;
+              HUFF_ERROR if the stream is not running
+Notes:        everything fed so far can be decoded from the output once this
+              returns 0, at the cost of a short block
+******************************************************************************/
+size_t huff_compress_flush(huff_cctx_t *cctx, huff_out_buffer_t *out) {
+    size_t pending, n;
+
+    if (cctx->state != STREAM_RUNNING) return HUFF_ERROR;
+
+    while ((pending = stream_drain(&cctx->pending, out)) == 0 && cctx->in_len > 0) {
+        n = cctx->in_len;
+        cctx->in_len = 0;
+        if (stream_emit_block(cctx, out, cctx->in_buf, n) != 0) return HUFF_ERROR;
+    }
+
+    return pending;
+}
+
+/******************************************************************************
+huff_compress_end:
+Purpose:      Finishes a compression stream
+Parameters:   cctx - context started by huff_compress_init
+              out - receives the last block, end marker and index
+Return:       bytes waiting for room in out, call again until 0;
+              HUFF_ERROR if no stream was started
+Notes:        streams of more than STREAM_MAX_INDEX blocks end without an
+              index and can only be decoded in order
+******************************************************************************/
+size_t huff_compress_end(huff_cctx_t *cctx, huff_out_buffer_t *out) {
+    size_t pending, n;
+
+    if (cctx->state == STREAM_RUNNING) {
+        if ((pending = huff_compress_flush(cctx, out)) != 0) return pending;
+
+        n = cctx->idx.num_blocks == cctx->enc.num_blocks ? block_index_size(&cctx->idx) : 0;
+        if (1 + n > cctx->index_cap) {
+            free(cctx->index_buf);
+            if ((cctx->index_buf = (unsigned char *)malloc(1 + n)) == NULL) {
+                cctx->index_cap = 0;
+                cctx->state = STREAM_ERROR;
+                return HUFF_ERROR;
+            }
+            cctx->index_cap = 1 + n;
+        }
+
+        cctx->index_buf[0] = BLOCK_END;
+        if (n > 0) block_index_store(&cctx->idx, cctx->index_buf + 1);
+
+        cctx->pending.buf = cctx->index_buf;
+        cctx->pending.len = 1 + n;
+        cctx->pending.pos = 0;
+        cctx->state = STREAM_ENDED;
+    }
+
+    if (cctx->state != STREAM_ENDED) return HUFF_ERROR;
+
+    return stream_drain(&cctx->pending, out);
+}
+
+/* Reports how the blocks of the last archive were coded
+ */
+void huff_cctx_stats(const huff_cctx_t *cctx, uint64_t *num_blocks, uint64_t *num_reused,
+                     uint64_t *num_raw, uint64_t *num_context, uint64_t *limit_cost) {
+    *num_blocks = cctx->enc.num_blocks;
+    *num_reused = cctx->enc.num_reused;
+    *num_raw = cctx->enc.num_raw;
+    *num_context = cctx->enc.num_context;
+    *limit_cost = cctx->enc.limit_cost;
+}
+
+/* Creates a decompression context
+ *
+ * Return: the context, NULL if out of memory
+ */
+huff_dctx_t *huff_dctx_create(void) {
+    huff_dctx_t *dctx = (huff_dctx_t *)calloc(1, sizeof(huff_dctx_t));
+
+    if (dctx == NULL) return NULL;
+
+    dctx->num_threads = 1;
+    block_decoder_init(&dctx->dec);
+    block_index_init(&dctx->idx);
+    return dctx;
+}
+
+void huff_dctx_free(huff_dctx_t *dctx) {
+    if (dctx == NULL) return;
+
+    block_decoder_free(&dctx->dec);
+    block_index_free(&dctx->idx);
+    free(dctx->in_buf);
+    free(dctx->out_buf);
+    free(dctx);
+}
+
+/* Sets the threads blocks are decoded on, 0 for one per CPU
+ */
+int huff_dctx_set_threads(huff_dctx_t *dctx, int num_threads) {
+    if (num_threads < 0) return -1;
+
+    dctx->num_threads = parallel_threads(num_threads);
+    return 0;
+}
+
+/******************************************************************************
+huff_decompress_dctx:
+Purpose:      Decompresses a .huf archive in src into dst
+Parameters:   dctx - context, its memory is reused
+              dst, dst_cap - output buffer, huff_decompressed_size(src)
+                             bytes are enough
+              src, src_len - the whole archive
+Return:       bytes stored, HUFF_ERROR if dst is too small or src is corrupt
+Notes:        decodes on several threads if set and the archive has tables
+              and an index
+******************************************************************************/
+size_t huff_decompress_dctx(huff_dctx_t *dctx, void *dst, size_t dst_cap, const void *src, size_t src_len) {
+    map_file_t in, out;
+
+    map_memory(&in, src, src_len);
+    map_memory(&out, dst, dst_cap);
+
+    if (decompress_archive(dctx, &in, &out) != 0) return HUFF_ERROR;
+    return out.pos;
+}
+
+/******************************************************************************
+huff_decompress_init:
+Purpose:      Starts decompressing a stream
+Parameters:   dctx - context, any stream it was decoding is abandoned
+Return:       0
+Notes:        the archive is fed with huff_decompress_update and checked for
+              completeness with huff_decompress_end; blocks are decoded in
+              order, the index is not needed
+******************************************************************************/
+int huff_decompress_init(huff_dctx_t *dctx) {
+    dctx->dec.have_table = 0;
+    dctx->state = STREAM_RUNNING;
+    dctx->part = PART_FILE_HEADER;
+    dctx->header_len = 0;
+    dctx->in_len = 0;
+    dctx->pending.len = dctx->pending.pos = 0;
+    return 0;
+}
+
+/******************************************************************************
+huff_decompress_update:
+Purpose:      Feeds part of an archive to a decompression stream
+Parameters:   dctx - context started by huff_decompress_init
+              out - receives the bytes decoded so far
+              in - archive, consumed up to in->pos
+Return:       bytes decoded but waiting for room in out,
+              HUFF_ERROR if the archive is corrupt
+Notes:        every block is decoded as soon as it is complete; input is
+              only left unconsumed when out is full; anything after the end
+              marker is consumed and ignored
+******************************************************************************/
+size_t huff_decompress_update(huff_dctx_t *dctx, huff_out_buffer_t *out, huff_in_buffer_t *in) {
+    const unsigned char *src = (const unsigned char *)in->src;
+    const unsigned char *payload;
+    size_t pending;
+    int mode;
+
+    if (dctx->state == STREAM_ENDED) {
+        in->pos = in->size;
+        return stream_drain(&dctx->pending, out);
+    }
+
+    if (dctx->state != STREAM_RUNNING) return HUFF_ERROR;
+
+    while ((pending = stream_drain(&dctx->pending, out)) == 0 && in->pos < in->size) {
+        if (dctx->part == PART_FILE_HEADER) {
+            if (stream_gather(dctx->header, &dctx->header_len, BLOCK_FILE_HEADER, in) < BLOCK_FILE_HEADER) break;
+            if (block_read_file_header(dctx->header, &dctx->block_size, &mode) != 0) goto corrupt;
+            block_decoder_start(&dctx->dec, mode);
+
+            // buffers are sized for the block size of the archive
+            free(dctx->in_buf);
+            free(dctx->out_buf);
+            dctx->in_buf = (unsigned char *)malloc(block_bound(dctx->block_size));
+            dctx->out_buf = (unsigned char *)malloc(dctx->block_size);
+            if (dctx->in_buf == NULL || dctx->out_buf == NULL) goto corrupt;
+
+            dctx->header_len = 0;
+            dctx->part = PART_BLOCK_HEADER;
+        } else if (dctx->part == PART_BLOCK_HEADER) {
+            // end marker, the index behind it is of no use here
+            if (dctx->header_len == 0 && src[in->pos] == BLOCK_END) {
+                in->pos = in->size;
+                dctx->state = STREAM_ENDED;
+                break;
+            }
+
+            if (stream_gather(dctx->header, &dctx->header_len, BLOCK_HEADER, in) < BLOCK_HEADER) break;
+            if (block_read_header(dctx->header, &dctx->flags, &dctx->raw_len, &dctx->comp_len) != 0 ||
+                    dctx->raw_len > dctx->block_size || dctx->comp_len > block_bound(dctx->block_size) - BLOCK_HEADER)
+                goto corrupt;
+
+            dctx->header_len = 0;
+            dctx->part = PART_PAYLOAD;
+        } else {
+            // decode straight from the input when the whole payload is there
+            if (dctx->in_len == 0 && in->size - in->pos >= dctx->comp_len) {
+                payload = src + in->pos;
+                in->pos += dctx->comp_len;
+            } else {
+                if (stream_gather(dctx->in_buf, &dctx->in_len, dctx->comp_len, in) < dctx->comp_len) break;
+                payload = dctx->in_buf;
+            }
+
+            if (stream_decode_block(dctx, out, payload) != 0) goto corrupt;
+
+            dctx->in_len = 0;
+            dctx->part = PART_BLOCK_HEADER;
+        }
+    }
+
+    return pending;
+
+corrupt:
+    dctx->state = STREAM_ERROR;
+    return HUFF_ERROR;
+}
+
+/* Hands decoded bytes still waiting to the caller
+ *
+ * Return: bytes still waiting for room in out
+ */
+size_t huff_decompress_flush(huff_dctx_t *dctx, huff_out_buffer_t *out) {
+    return stream_drain(&dctx->pending, out);
+}
+
+/* Checks that a decompression stream saw the whole archive
+ *
+ * Return: 0 if the end marker was read and all output handed over, -1 if
+ *         the archive was cut short or corrupt
+ */
+int huff_decompress_end(huff_dctx_t *dctx) {
+    int status = dctx->state == STREAM_ENDED && dctx->pending.pos == dctx->pending.len ? 0 : -1;
+
+    dctx->state = STREAM_IDLE;
+    return status;
+}
+
+/******************************************************************************
+compress_archive:
+Purpose:      Codes all blocks of the input and writes the archive
+Parameters:   cctx - context
+              in - input map
+              out - output map
+Return:       0 on success, -1 if the output is full or out of memory
+******************************************************************************/
+int compress_archive(huff_cctx_t *cctx, map_file_t *in, map_file_t *out) {
+    unsigned char header[BLOCK_FILE_HEADER], *dst;
+    const unsigned char *block;
+    uint64_t in_len;
+    size_t n;
+
+    if (cctx->out_buf == NULL) {
+        cctx->out_buf = (unsigned char *)malloc(block_bound(cctx->block_size));
+        if (cctx->out_buf == NULL) return -1;
+    }
+
+    block_encoder_init(&cctx->enc, cctx->max_len, cctx->num_streams, block_mode(cctx->mode));
+    block_index_reset(&cctx->idx);
+    cctx->state = STREAM_IDLE;
+
+    block_write_file_header(header, cctx->block_size, cctx->enc.mode);
+    if (map_write(out, header, BLOCK_FILE_HEADER) != 0) return -1;
+
+    // code each block of the input with its own or the previous table,
+    // blocks of an adaptive archive one after the other
+    if (cctx->num_threads > 1 && cctx->enc.mode != BLOCK_ADAPTIVE) {
+        if (parallel_compress(&cctx->enc, &cctx->idx, in, out, cctx->block_size, cctx->num_threads, &in_len) != 0)
+            return -1;
+    } else {
+        while ((n = map_read(in, &block, NULL, cctx->block_size)) > 0) {
+            // code in place when the output has room for the encoder slack
+            dst = map_reserve(out, NULL, block_bound(n));
+            if (dst == NULL) dst = cctx->out_buf;
+
+            if ((n = block_compress(&cctx->enc, block, n, dst)) == 0) return -1;
+            if (block_index_add(&cctx->idx, dst) != 0 || map_write(out, dst, n) != 0) return -1;
+        }
+    }
+
+    // end marker and block index for out of order decoding
+    n = 1 + block_index_size(&cctx->idx);
+    if (n > cctx->index_cap) {
+        free(cctx->index_buf);
+        if ((cctx->index_buf = (unsigned char *)malloc(n)) == NULL) {
+            cctx->index_cap = 0;
+            return -1;
+        }
+        cctx->index_cap = n;
+    }
+
+    cctx->index_buf[0] = BLOCK_END;
+    block_index_store(&cctx->idx, cctx->index_buf + 1);
+    return map_write(out, cctx->index_buf, n);
+}
+
+/******************************************************************************
+decompress_archive:
+Purpose:      Decodes all blocks of an archive
+Parameters:   dctx - context
+              in - archive map
+              out - output map
+Return:       0 on success, -1 if the archive is corrupt or the output full
+Notes:        blocks are decoded in order unless the context has several
+              threads and the archive has tables and an index
+******************************************************************************/
+int decompress_archive(huff_dctx_t *dctx, map_file_t *in, map_file_t *out) {
+    const unsigned char *p;
+    unsigned char *dst;
+    size_t block_size, raw_len, comp_len;
+    int flags, mode;
+
+    if (map_read(in, &p, NULL, BLOCK_FILE_HEADER) != BLOCK_FILE_HEADER ||
+            block_read_file_header(p, &block_size, &mode) != 0)
+        return -1;
+
+    // tables of the last archive must not be reused, only their memory
+    block_decoder_start(&dctx->dec, mode);
+    dctx->state = STREAM_IDLE;
+    block_index_reset(&dctx->idx);
+    if (dctx->num_threads > 1 && mode == BLOCK_STATIC && load_index(&dctx->idx, in, block_size) == 0)
+        return parallel_decompress(&dctx->idx, in, out, block_size, dctx->num_threads);
+
+    // decode each block into the output
+    for (;;) {
+        if (in->pos >= in->len) return -1;
+        if (in->data[in->pos] == BLOCK_END) return 0;
+
+        if (map_read(in, &p, NULL, BLOCK_HEADER) != BLOCK_HEADER ||
+                block_read_header(p, &flags, &raw_len, &comp_len) != 0 ||
+                raw_len > block_size || map_read(in, &p, NULL, comp_len) != comp_len ||
+                (dst = map_reserve(out, NULL, raw_len)) == NULL ||
+                block_decompress(&dctx->dec, flags, p, comp_len, dst, raw_len) != 0 ||
+                map_write(out, dst, raw_len) != 0)
+            return -1;
+    }
+}
+
+/******************************************************************************
+load_index:
+Purpose:      Reads the block index at the end of an archive
+Parameters:   idx - empty index to fill
+              in - the whole archive
+              block_size - block size from the file header
+Return:       0 on success, -1 if the archive has no usable index
+******************************************************************************/
+int load_index(block_index_t *idx, const map_file_t *in, size_t block_size) {
+    uint64_t index_offset, num_blocks;
+
+    // footer ends the archive, index entries come right before it
+    if (in->len < BLOCK_FILE_HEADER + 1 + BLOCK_FOOTER ||
+            block_read_footer(in->data + in->len - BLOCK_FOOTER, &index_offset, &num_blocks) != 0 ||
+            index_offset > in->len - BLOCK_FOOTER ||
+            num_blocks != (in->len - BLOCK_FOOTER - index_offset) / BLOCK_INDEX_ENTRY ||
+            (in->len - BLOCK_FOOTER - index_offset) % BLOCK_INDEX_ENTRY != 0)
+        return -1;
+
+    if (block_index_load(idx, in->data + index_offset, num_blocks, block_size) != 0 ||
+            idx->end_offset >= index_offset) {
+        block_index_reset(idx);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Allocates the streaming buffers of a compression context
+ *
+ * Return: 0 on success, -1 if out of memory
+ */
+int stream_buffers(huff_cctx_t *cctx) {
+    if (cctx->out_buf == NULL) cctx->out_buf = (unsigned char *)malloc(block_bound(cctx->block_size));
+    if (cctx->in_buf == NULL) cctx->in_buf = (unsigned char *)malloc(cctx->block_size);
+
+    return cctx->out_buf != NULL && cctx->in_buf != NULL ? 0 : -1;
+}
+
+/******************************************************************************
+stream_emit_block:
+Purpose:      Codes one block of a compression stream
+Parameters:   cctx - context
+              out - caller's output, must have nothing pending before it
+              src, len - bytes of the block
+Return:       0 on success, -1 if out of memory
+Notes:        codes straight into out when it has room for the encoder
+              slack, otherwise into the context and leaves it pending
+******************************************************************************/
+int stream_emit_block(huff_cctx_t *cctx, huff_out_buffer_t *out, const unsigned char *src, size_t len) {
+    unsigned char *dst = cctx->out_buf;
+    size_t n;
+
+    if (out->size - out->pos >= block_bound(len)) dst = (unsigned char *)out->dst + out->pos;
+
+    if ((n = block_compress(&cctx->enc, src, len, dst)) == 0) return -1;
+
+    // index memory is bounded, very long streams go without
+    if (cctx->idx.num_blocks < STREAM_MAX_INDEX && block_index_add(&cctx->idx, dst) != 0) return -1;
+
+    if (dst == cctx->out_buf) {
+        cctx->pending.buf = dst;
+        cctx->pending.len = n;
+        cctx->pending.pos = 0;
+    } else {
+        out->pos += n;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+stream_decode_block:
+Purpose:      Decodes the current block of a decompression stream
+Parameters:   dctx - context holding the block header
+              out - caller's output, must have nothing pending before it
+              payload - comp_len bytes of payload
+Return:       0 on success, -1 if the block is corrupt
+Notes:        decodes straight into out when it has room, otherwise into the
+              context and leaves it pending
+******************************************************************************/
+int stream_decode_block(huff_dctx_t *dctx, huff_out_buffer_t *out, const unsigned char *payload) {
+    unsigned char *dst = dctx->out_buf;
+
+    if (out->size - out->pos >= dctx->raw_len) dst = (unsigned char *)out->dst + out->pos;
+
+    if (block_decompress(&dctx->dec, dctx->flags, payload, dctx->comp_len, dst, dctx->raw_len) != 0) return -1;
+
+    if (dst == dctx->out_buf) {
+        dctx->pending.buf = dst;
+        dctx->pending.len = dctx->raw_len;
+        dctx->pending.pos = 0;
+    } else {
+        out->pos += dctx->raw_len;
+    }
+
+    return 0;
+}
+
+/* Copies pending bytes into out
+ *
+ * Return: bytes still pending
+ */
+size_t stream_drain(stream_pending_t *pending, huff_out_buffer_t *out) {
+    size_t n = pending->len - pending->pos;
+
+    if (n > out->size - out->pos) n = out->size - out->pos;
+
+    if (n > 0) memcpy((unsigned char *)out->dst + out->pos, pending->buf + pending->pos, n);
+    out->pos += n;
+    pending->pos += n;
+    return pending->len - pending->pos;
+}
+
+/* Moves input into buf until it holds want bytes
+ *
+ * Return: bytes now in buf
+ */
+size_t stream_gather(unsigned char *buf, size_t *len, size_t want, huff_in_buffer_t *in) {
+    size_t n = want - *len;
+
+    if (n > in->size - in->pos) n = in->size - in->pos;
+
+    if (n > 0) memcpy(buf + *len, (const unsigned char *)in->src + in->pos, n);
+    in->pos += n;
+    *len += n;
+    return *len;
+}
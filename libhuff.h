@@ -0,0 +1,76 @@
+//
+//  libhuff.h
+//  API for in-memory Huffman compression of .huf archives
+//  buffer to buffer calls with reusable contexts, no files involved
+//
+
+#ifndef LIBHUFF_H
+#define LIBHUFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HUFF_ERROR ((size_t)-1)     // returned by calls that fail
+
+// compression settings and their limits
+#define HUFF_DEFAULT_BLOCK_SIZE (1 << 20)
+#define HUFF_MIN_BLOCK_SIZE (1 << 12)
+#define HUFF_MAX_BLOCK_SIZE (1 << 26)
+#define HUFF_DEFAULT_MAX_LEN 12     // code length limit
+#define HUFF_MIN_MAX_LEN 8
+#define HUFF_MAX_MAX_LEN 56
+#define HUFF_DEFAULT_STREAMS 1      // bitstreams per block, 1, 4 or 8
+
+// coding modes
+#define HUFF_MODE_STATIC 0          // a code table per block, sent with it
+#define HUFF_MODE_ADAPTIVE 1        // one adaptive tree, updated as symbols are coded
+#define HUFF_MODE_ORDER1 2          // as static, or tables picked by the byte before each symbol
+
+typedef struct huff_cctx_tag huff_cctx_t;   // compression context
+typedef struct huff_dctx_tag huff_dctx_t;   // decompression context
+
+// input of a streaming call, pos advances past the bytes consumed
+typedef struct huff_in_buffer_tag {
+    const void *src;
+    size_t size;
+    size_t pos;
+} huff_in_buffer_t;
+
+// output of a streaming call, pos advances past the bytes produced
+typedef struct huff_out_buffer_tag {
+    void *dst;
+    size_t size;
+    size_t pos;
+} huff_out_buffer_t;
+
+// public prototype definitions for libhuff.c
+size_t huff_compress_bound(size_t src_len);
+size_t huff_compress(void *dst, size_t dst_cap, const void *src, size_t src_len);
+size_t huff_decompress(void *dst, size_t dst_cap, const void *src, size_t src_len);
+size_t huff_decompressed_size(const void *src, size_t src_len);
+
+huff_cctx_t *huff_cctx_create(void);
+void huff_cctx_free(huff_cctx_t *cctx);
+int huff_cctx_set_max_len(huff_cctx_t *cctx, int max_len);
+int huff_cctx_set_block_size(huff_cctx_t *cctx, size_t block_size);
+int huff_cctx_set_threads(huff_cctx_t *cctx, int num_threads);
+int huff_cctx_set_streams(huff_cctx_t *cctx, int num_streams);
+int huff_cctx_set_mode(huff_cctx_t *cctx, int mode);
+size_t huff_compress_cctx(huff_cctx_t *cctx, void *dst, size_t dst_cap, const void *src, size_t src_len);
+int huff_compress_init(huff_cctx_t *cctx);
+size_t huff_compress_update(huff_cctx_t *cctx, huff_out_buffer_t *out, huff_in_buffer_t *in);
+size_t huff_compress_flush(huff_cctx_t *cctx, huff_out_buffer_t *out);
+size_t huff_compress_end(huff_cctx_t *cctx, huff_out_buffer_t *out);
+void huff_cctx_stats(const huff_cctx_t *cctx, uint64_t *num_blocks, uint64_t *num_reused,
+                     uint64_t *num_raw, uint64_t *num_context, uint64_t *limit_cost);
+
+huff_dctx_t *huff_dctx_create(void);
+void huff_dctx_free(huff_dctx_t *dctx);
+int huff_dctx_set_threads(huff_dctx_t *dctx, int num_threads);
+size_t huff_decompress_dctx(huff_dctx_t *dctx, void *dst, size_t dst_cap, const void *src, size_t src_len);
+int huff_decompress_init(huff_dctx_t *dctx);
+size_t huff_decompress_update(huff_dctx_t *dctx, huff_out_buffer_t *out, huff_in_buffer_t *in);
+size_t huff_decompress_flush(huff_dctx_t *dctx, huff_out_buffer_t *out);
+int huff_decompress_end(huff_dctx_t *dctx);
+
+#endif
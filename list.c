@@ -10,9 +10,52 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "list.h"        // defines public functions for list ADT
+#include "stats.h"
+
+// arena memory is handed out in multiples of this, enough for pointers and data_t
+#define LIST_ALIGN 8
+#define LIST_ROUND(n) (((n) + LIST_ALIGN - 1) & ~(size_t)(LIST_ALIGN - 1))
 
 // prototypes for private functions used in list.c only
 void merge_sort(list_t *);
+void *list_arena_alloc(list_arena_t *, size_t);
+void list_header_init(list_t *, int (*)(const data_t *, const data_t *), int (*)(const data_t *, const data_t *),
+                      list_arena_t *);
+list_node_t *list_node_alloc(list_t *);
+void list_node_release(list_t *, list_node_t *);
+void list_link(list_t *, list_node_t *, list_node_t *);
+
+/* Prepares an empty arena
+ *
+ * buf, size: memory used before any chunk is allocated; may be NULL. Lists
+ * taken from a buffer large enough for them never touch the heap.
+ */
+void list_arena_init(list_arena_t *arena, void *buf, size_t size) {
+    arena->base = (unsigned char *)buf;
+    arena->size = buf != NULL ? size : 0;
+    arena->cur = arena->base;
+    arena->cur_size = arena->size;
+    arena->used = 0;
+    arena->chunks = NULL;
+    arena->free_nodes = NULL;
+}
+
+/* Empties an arena, releasing every list and node taken from it at once
+ *
+ * Only chunks added after the caller's buffer ran out are freed, so
+ * resetting an arena whose buffer sufficed is O(1). Elements inserted with
+ * list_insert are not freed.
+ */
+void list_arena_reset(list_arena_t *arena) {
+    list_chunk_t *chunk, *next;
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    list_arena_init(arena, arena->base, arena->size);
+}
 
 /* Allocates a new, empty list
  *
@@ -20,16 +63,110 @@ void merge_sort(list_t *);
  *
  * Use list_destruct to remove and deallocate all elements on a list
  * and the header block.
+ *
+ * Return: the list, NULL if out of memory
  */
 list_t *list_construct(int (*fcomp)(const data_t *, const data_t *), int (*scomp)(const data_t *, const data_t *)) {
+    list_arena_t *arena;
     list_t *L;
-    L = (list_t *) malloc(sizeof(list_t));
+
+    // the list's own arena, released by list_destruct
+    arena = (list_arena_t *) malloc(sizeof(list_arena_t));
+    STATS_ALLOC();
+    if (arena == NULL) return NULL;
+    list_arena_init(arena, NULL, 0);
+
+    L = list_construct_arena(fcomp, scomp, arena);
+    if (L == NULL) {
+        free(arena);
+        return NULL;
+    }
+    L->own_arena = 1;
+    return L;
+}
+
+/* Allocates a new, empty list and its nodes from an arena
+ *
+ * Use list_arena_reset to release the list along with everything else in
+ * the arena; list_destruct only frees the elements inserted with
+ * list_insert.
+ *
+ * Return: the list, NULL if out of memory
+ */
+list_t *list_construct_arena(int (*fcomp)(const data_t *, const data_t *), int (*scomp)(const data_t *, const data_t *),
+                             list_arena_t *arena) {
+    list_t *L = (list_t *) list_arena_alloc(arena, sizeof(list_t));
+
+    if (L == NULL) return NULL;
+    list_header_init(L, fcomp, scomp, arena);
+    return L;
+}
+
+// set up an empty list header
+void list_header_init(list_t *L, int (*fcomp)(const data_t *, const data_t *),
+                      int (*scomp)(const data_t *, const data_t *), list_arena_t *arena) {
     L->head = NULL;
     L->tail = NULL;
     L->current_list_size = 0;
+    L->list_sorted_state = 0;
+    L->arena = arena;
+    L->own_arena = 0;
     L->comp_proc = fcomp;
     L->comp_sort = scomp;
-    return L;
+}
+
+/******************************************************************************
+list_arena_alloc:
+Purpose:      Takes memory for a list header or node from an arena
+Parameters:   arena - arena to allocate from
+              size - bytes needed, at most a chunk's worth
+Return:       pointer to the memory, NULL if out of memory
+Notes:        falls back to a new LIST_ARENA_CHUNK once the current buffer
+              is used up; nothing is freed until the arena is reset
+******************************************************************************/
+void *list_arena_alloc(list_arena_t *arena, size_t size) {
+    list_chunk_t *chunk;
+    void *ptr;
+
+    size = LIST_ROUND(size);
+    assert(size <= LIST_ARENA_CHUNK - LIST_ROUND(sizeof(list_chunk_t)));
+
+    if (arena->used + size > arena->cur_size) {
+        chunk = (list_chunk_t *) malloc(LIST_ARENA_CHUNK);
+        STATS_ALLOC();
+        if (chunk == NULL) return NULL;
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->cur = (unsigned char *)chunk + LIST_ROUND(sizeof(list_chunk_t));
+        arena->cur_size = LIST_ARENA_CHUNK - LIST_ROUND(sizeof(list_chunk_t));
+        arena->used = 0;
+    }
+
+    ptr = arena->cur + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+// take a node from those given back, or from the arena
+list_node_t *list_node_alloc(list_t *list_ptr) {
+    list_arena_t *arena = list_ptr->arena;
+    list_node_t *node = arena->free_nodes;
+
+    if (node != NULL) {
+        arena->free_nodes = node->next;
+        return node;
+    }
+
+    return (list_node_t *) list_arena_alloc(arena, sizeof(list_node_t));
+}
+
+// give a removed node back for reuse, unless its element lives inside it
+void list_node_release(list_t *list_ptr, list_node_t *node) {
+    if (node->data_ptr == &node->data) return;
+
+    node->next = list_ptr->arena->free_nodes;
+    list_ptr->arena->free_nodes = node;
 }
 
 /* Purpose: return the count of number of elements in the list.
@@ -50,44 +187,48 @@ int list_size(list_t *list_ptr) {
  * Free all elements in the list and the header block.
  */
 void list_destruct(list_t *list_ptr) {
-    int i;
-    list_node_t *nextNode;
-    list_node_t *rover = list_ptr->head;
+    list_arena_t *arena = list_ptr->own_arena ? list_ptr->arena : NULL;
+    list_node_t *rover;
 
-    // go through all items in the list
-    for (i = 0; i < list_ptr->current_list_size; i++) {
-        free(rover->data_ptr);
-        nextNode = rover->next;
-        rover->next = NULL;
-        rover->prev = NULL;
-        rover->data_ptr = NULL;
-        free(rover);
-        rover = nextNode;
+    // elements copied into their nodes go with the arena
+    for (rover = list_ptr->head; rover != NULL; rover = rover->next) {
+        if (rover->data_ptr != &rover->data) free(rover->data_ptr);
     }
 
     list_ptr->head = NULL;
     list_ptr->tail = NULL;
-    free(list_ptr);
+
+    // nodes and header go in one step with the list's own arena
+    if (arena != NULL) {
+        list_arena_reset(arena);
+        free(arena);
+    }
 }
 
 void tree_destruct(list_t *T) {
-    // free all nodes in the tree recursively
+    list_arena_t *arena = T->own_arena ? T->arena : NULL;
+
+    // free all elements in the tree recursively
     free_tree(T->head);
-    // free header
-    free(T);
+
+    // nodes and header go with the arena
+    if (arena != NULL) {
+        list_arena_reset(arena);
+        free(arena);
+    }
 }
 
 /* free_tree
- * Purpose:   frees all of the nodes in a tree recursively after a given node
+ * Purpose:   frees the elements of a tree recursively after a given node
  * Argument:  binary search tree node pointer
  * Return:    void
+ * Notes:     the nodes themselves belong to the list's arena
 */
 void free_tree(list_node_t *N) {
     if (N != NULL) {
         free_tree(N->right);
         free_tree(N->left);
-        free(N->data_ptr);
-        free(N);
+        if (N->data_ptr != &N->data) free(N->data_ptr);
     }
 }
 
@@ -136,56 +277,71 @@ Purpose:      Sorts a list in descending order according to the merge sort
               algorithm
 Parameters:   L - a two-way linked list of nodes to be sorted
 Return:       void
-Notes:        uses recursion
+Notes:        bottom-up and in place: runs of width 1, 2, 4, ... are merged
+              by relinking next pointers, so nothing is allocated and there
+              is no recursion; prev pointers and the tail are restored at
+              the end. Stable, the left run wins unless comp_sort returns -1
 ******************************************************************************/
 void merge_sort(list_t *L) {
-    int i, list_size = L->current_list_size;
-    data_t *data;
-
-    // check if the list has more than one node in it
-    if (list_size > 1) {
-        // construct LeftList & RightList lists
-        list_t *LeftList = list_construct(L->comp_sort, L->comp_sort);
-        list_t *RightList = list_construct(L->comp_sort, L->comp_sort);
-
-        // break list into two halves
-        // populate LeftList
-        for (i = 0; i < list_size / 2; i++) {
-            data = list_remove(L, L->head);
-            list_insert(LeftList, data, NULL);
-            data = NULL;
-        }
-
-        // populate RightList
-        while (L->head != NULL) {
-            data = list_remove(L, L->head);
-            list_insert(RightList, data, NULL);
-            data = NULL;
+    list_node_t *head = L->head, *tail, *left, *right, *node;
+    int width, merges, left_size, right_size;
+
+    if (L->current_list_size < 2) return;
+
+    for (width = 1; ; width *= 2) {
+        left = head;
+        head = NULL;
+        tail = NULL;
+        merges = 0;
+
+        while (left != NULL) {
+            merges++;
+
+            // right run starts width nodes after the left one
+            right = left;
+            for (left_size = 0; left_size < width && right != NULL; left_size++)
+                right = right->next;
+            right_size = width;
+
+            // merge the two runs onto the end of the new chain
+            while (left_size > 0 || (right_size > 0 && right != NULL)) {
+                if (left_size == 0) {
+                    node = right;
+                    right = right->next;
+                    right_size--;
+                } else if (right_size == 0 || right == NULL ||
+                           L->comp_sort(left->data_ptr, right->data_ptr) != -1) {
+                    node = left;
+                    left = left->next;
+                    left_size--;
+                } else {
+                    node = right;
+                    right = right->next;
+                    right_size--;
+                }
+
+                if (tail != NULL)
+                    tail->next = node;
+                else
+                    head = node;
+                tail = node;
+            }
+
+            // next pair of runs follows the right one
+            left = right;
         }
+        tail->next = NULL;
 
-        // sort LeftList  & RightList using MergeSort
-        merge_sort(LeftList);
-        merge_sort(RightList);
-
-        // merge lists
-        while (LeftList->head != NULL || RightList->head != NULL) {
-            // determine from which list the node should be added
-            if (LeftList->head == NULL) // LeftList is empty
-                data = list_remove(RightList, RightList->head);
-            else if (RightList->head == NULL) // RightList is empty
-                data = list_remove(LeftList, LeftList->head);
-            else if (L->comp_sort(LeftList->head->data_ptr, RightList->head->data_ptr) != -1)
-                data = list_remove(LeftList, LeftList->head);
-            else if (L->comp_sort(RightList->head->data_ptr, LeftList->head->data_ptr) != -1)
-                data = list_remove(RightList, RightList->head);
-
-            // add the node back to the original list
-            list_insert(L, data, NULL);
-        }
-
-        free(LeftList);
-        free(RightList);
+        // a single merge covered the whole list
+        if (merges <= 1) break;
     }
+
+    // restore the backward links
+    L->head = head;
+    head->prev = NULL;
+    for (node = head; node->next != NULL; node = node->next)
+        node->next->prev = node;
+    L->tail = node;
 }
 
 /* Finds an element in a list and returns a pointer to it.
@@ -249,9 +405,32 @@ list_node_t *list_elem_find(list_t *list_ptr, data_t *elem_ptr) {
 
 void list_insert(list_t *list_ptr, data_t *elem_ptr, list_node_t *idx_ptr) {
     assert(NULL != list_ptr);
-    list_node_t *newNode = (list_node_t *)malloc(sizeof(list_node_t));
+    list_node_t *newNode = list_node_alloc(list_ptr);
     newNode->data_ptr = elem_ptr;
+    newNode->left = NULL;
+    newNode->right = NULL;
+    list_link(list_ptr, newNode, idx_ptr);
+}
+
+/* Inserts a copy of the data element, stored inside its node, in front of
+ * the iterator position as list_insert does.
+ *
+ * Return: pointer to the copy, which lives in the list's arena and is never
+ *         freed on its own, not even by list_remove
+ */
+data_t *list_insert_copy(list_t *list_ptr, const data_t *elem_ptr, list_node_t *idx_ptr) {
+    assert(NULL != list_ptr);
+    list_node_t *newNode = list_node_alloc(list_ptr);
+    newNode->data = *elem_ptr;
+    newNode->data_ptr = &newNode->data;
+    newNode->left = NULL;
+    newNode->right = NULL;
+    list_link(list_ptr, newNode, idx_ptr);
+    return newNode->data_ptr;
+}
 
+// link a node into a list in front of idx_ptr, or at the end if it is NULL
+void list_link(list_t *list_ptr, list_node_t *newNode, list_node_t *idx_ptr) {
     // node is to be added at the end of the list
     if (idx_ptr == NULL) {
         newNode->next = NULL;
@@ -308,9 +487,9 @@ void list_insert(list_t *list_ptr, data_t *elem_ptr, list_node_t *idx_ptr) {
  * You should not call list_iter_next on an iterator after there
  * has been a call to list_remove with the same iterator.
  *
- * When you remove the list_node_t in this function, you should null the next
- * and prev pointers before you free the memory block to avoid accidental use
- * of these now invalid pointers.
+ * The removed node goes back to the list's arena for reuse, unless it holds
+ * the element itself (list_insert_copy), which then stays valid until the
+ * arena is reset.
  */
 
 data_t *list_remove(list_t *list_ptr, list_node_t *idx_ptr) {
@@ -323,41 +502,26 @@ data_t *list_remove(list_t *list_ptr, list_node_t *idx_ptr) {
 
     data_t *dataPtr;
 
-    // check if there is only one element left
-    if (list_ptr->current_list_size == 1) {
-        dataPtr = list_ptr->head->data_ptr;
-        free(list_ptr->head);
-        list_ptr->head = NULL;
-        list_ptr->tail = NULL;
-    } else {
-        // remove last item in the list
-        if (idx_ptr == NULL) {
-            dataPtr = list_ptr->tail->data_ptr;
-            list_ptr->tail = list_ptr->tail->prev;
-            list_ptr->tail->next->prev = NULL;
-            free(list_ptr->tail->next);
-            list_ptr->tail->next = NULL;
-        } else {
-            // store temp pointer to data
-            dataPtr = idx_ptr->data_ptr;
-            idx_ptr->data_ptr = NULL;
-
-            // reset head and tail pointers if necessary
-            if (idx_ptr == list_ptr->head) list_ptr->head = idx_ptr->next;
-
-            if (idx_ptr == list_ptr->tail) list_ptr->tail = idx_ptr->prev;
-
-            // reset pointers around deleted node
-            if (idx_ptr->prev != NULL) idx_ptr->prev->next = idx_ptr->next;
-
-            if (idx_ptr->next != NULL) idx_ptr->next->prev = idx_ptr->prev;
-
-            idx_ptr->next = NULL;
-            idx_ptr->prev = NULL;
-            free(idx_ptr);
-            idx_ptr = NULL;
-        }
-    }
+    // remove last item in the list
+    if (idx_ptr == NULL) idx_ptr = list_ptr->tail;
+
+    // store temp pointer to data
+    dataPtr = idx_ptr->data_ptr;
+
+    // reset head and tail pointers if necessary
+    if (idx_ptr == list_ptr->head) list_ptr->head = idx_ptr->next;
+
+    if (idx_ptr == list_ptr->tail) list_ptr->tail = idx_ptr->prev;
+
+    // reset pointers around deleted node
+    if (idx_ptr->prev != NULL) idx_ptr->prev->next = idx_ptr->next;
+
+    if (idx_ptr->next != NULL) idx_ptr->next->prev = idx_ptr->prev;
+
+    idx_ptr->next = NULL;
+    idx_ptr->prev = NULL;
+    list_node_release(list_ptr, idx_ptr);
+    idx_ptr = NULL;
 
     list_ptr->current_list_size--;
     return dataPtr;
@@ -7,9 +7,22 @@
 //  Copyright © 2020 Adam Patyk. All rights reserved.
 //
 
+#ifndef LIST_H
+#define LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIST_ARENA_CHUNK 16384    // bytes per chunk an arena adds when it runs out
+
+// the structs below are public only so callers can size arena buffers;
+// their layout is not stable: data_t.freq became 64 bits and list_t gained
+// arena and own_arena, so code built against an older list.h must be
+// rebuilt, and only list.c should touch the private members
+
 typedef struct list_data_tag {
     unsigned char sym;	  // symbol
-    int freq;	            // frequency of symbol in file
+    uint64_t freq;	      // frequency of symbol in file
 } data_t;
 
 typedef struct list_node_tag {
@@ -19,14 +32,33 @@ typedef struct list_node_tag {
     struct list_node_tag *next;
     struct list_node_tag *left;
     struct list_node_tag *right;
+    data_t data;            // element copied in by list_insert_copy
 } list_node_t;
 
+typedef struct list_chunk_tag {
+    struct list_chunk_tag *next;
+} list_chunk_t;
+
+// bump allocator for list headers and nodes, emptied all at once
+typedef struct list_arena_tag {
+    // private members for list.c only
+    unsigned char *base;    // caller's buffer, used first
+    size_t size;
+    size_t used;            // bytes taken from the current buffer
+    unsigned char *cur;
+    size_t cur_size;
+    list_chunk_t *chunks;   // extra chunks, freed by list_arena_reset
+    list_node_t *free_nodes;    // nodes given back by list_remove
+} list_arena_t;
+
 typedef struct list_tag {
     // private members for list.c only
     list_node_t *head;
     list_node_t *tail;
     int current_list_size;
     int list_sorted_state;
+    list_arena_t *arena;    // memory of the header and nodes
+    int own_arena;          // arena belongs to this list alone
     // Private method for list.c only
     int (*comp_proc) (const data_t *, const data_t *);
     int (*comp_sort) (const data_t *, const data_t *);
@@ -34,8 +66,14 @@ typedef struct list_tag {
 
 // public prototype definitions for list.c
 
+// arenas shared by lists
+void list_arena_init(list_arena_t * arena, void * buf, size_t size);
+void list_arena_reset(list_arena_t * arena);
+
 // build and cleanup lists
 list_t * list_construct(int (*fcomp)(const data_t *, const data_t *), int (*scomp)(const data_t *, const data_t *));
+list_t * list_construct_arena(int (*fcomp)(const data_t *, const data_t *), int (*scomp)(const data_t *, const data_t *),
+                              list_arena_t * arena);
 void list_destruct(list_t * list_ptr);
 void tree_destruct(list_t *);
 void free_tree(list_node_t *);
@@ -48,6 +86,9 @@ list_node_t * list_iter_next(list_node_t * idx_ptr);
 data_t * list_access(list_t * list_ptr, list_node_t * idx_ptr);
 list_node_t * list_elem_find(list_t * list_ptr, data_t *elem_ptr);
 void list_insert(list_t * list_ptr, data_t *elem_ptr, list_node_t * idx_ptr);
+data_t * list_insert_copy(list_t * list_ptr, const data_t *elem_ptr, list_node_t * idx_ptr);
 data_t * list_remove(list_t * list_ptr, list_node_t * idx_ptr);
 int list_size(list_t * list_ptr);
 void list_sort(list_t * list_ptr);
+
+#endif
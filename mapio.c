@@ -0,0 +1,171 @@
+//
+//  mapio.c
+//  API for memory-mapped file input and output
+//  files are coded in place in their mapping, pipes fall back to stdio
+//
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapio.h"
+
+/* Sets up a map over a buffer already in memory, for reading or for writing
+ * up to len bytes
+ */
+void map_memory(map_file_t *m, const void *buf, size_t len) {
+    static unsigned char empty;
+
+    m->fpt = NULL;
+    m->data = len ? (unsigned char *)buf : &empty;
+    m->len = len;
+    m->pos = 0;
+}
+
+/******************************************************************************
+map_open_input:
+Purpose:      Maps the rest of an input file for reading
+Parameters:   m - map to set up
+              fpt - input, reading continues from its current position
+Return:       void
+Notes:        falls back to buffered reads from fpt for pipes, empty files
+              or if mmap fails; m->data tells which one is in use
+******************************************************************************/
+void map_open_input(map_file_t *m, FILE *fpt) {
+    struct stat st;
+    off_t pos = ftello(fpt);
+    void *data;
+
+    m->fpt = fpt;
+    m->data = NULL;
+    m->len = 0;
+    m->pos = 0;
+
+    if (pos < 0 || fstat(fileno(fpt), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= pos ||
+            (uint64_t)st.st_size > (size_t)-1)
+        return;
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fpt), 0);
+    if (data == MAP_FAILED) return;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    m->data = (unsigned char *)data;
+    m->len = st.st_size;
+    m->pos = pos;
+}
+
+/* Unmaps an input opened by map_open_input, the file stays open
+ */
+void map_close_input(map_file_t *m) {
+    if (m->data != NULL) munmap(m->data, m->len);
+    m->data = NULL;
+}
+
+/******************************************************************************
+map_read:
+Purpose:      Reads up to len bytes of input
+Parameters:   m - input map
+              buf - receives where the bytes are
+              scratch - buffer of len bytes for buffered input
+              len - bytes wanted
+Return:       bytes read, fewer than len only at the end of the input
+Notes:        mapped input is not copied, buf points into the mapping
+******************************************************************************/
+size_t map_read(map_file_t *m, const unsigned char **buf, unsigned char *scratch, size_t len) {
+    if (m->data == NULL) {
+        *buf = scratch;
+        return fread(scratch, 1, len, m->fpt);
+    }
+
+    if (len > m->len - m->pos) len = m->len - m->pos;
+
+    *buf = m->data + m->pos;
+    m->pos += len;
+    return len;
+}
+
+/******************************************************************************
+map_open_output:
+Purpose:      Preallocates and maps an empty output file
+Parameters:   m - map to set up
+              fpt - output, opened for reading and writing with nothing
+                    written yet
+              cap - most bytes that will be written, 0 if unknown
+Return:       void
+Notes:        falls back to buffered writes to fpt if the size is unknown
+              or the file cannot be mapped; map_close_output cuts the file
+              to the bytes actually written
+******************************************************************************/
+void map_open_output(map_file_t *m, FILE *fpt, size_t cap) {
+    int fd = fileno(fpt);
+    void *data;
+
+    m->fpt = fpt;
+    m->data = NULL;
+    m->len = 0;
+    m->pos = 0;
+
+    if (cap == 0) return;
+
+    if (posix_fallocate(fd, 0, cap) != 0 ||
+            (data = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        // leave the file empty for buffered writes
+        if (ftruncate(fd, 0) != 0) clearerr(fpt);
+        return;
+    }
+
+    m->data = (unsigned char *)data;
+    m->len = cap;
+}
+
+/* Unmaps an output and cuts the file to the bytes written, the file stays
+ * open
+ *
+ * Return: 0 on success, -1 if the file could not be resized
+ */
+int map_close_output(map_file_t *m) {
+    int status = 0;
+
+    if (m->data == NULL) return fflush(m->fpt) == 0 ? 0 : -1;
+
+    munmap(m->data, m->len);
+    if (ftruncate(fileno(m->fpt), m->pos) != 0) status = -1;
+
+    m->data = NULL;
+    return status;
+}
+
+/******************************************************************************
+map_reserve:
+Purpose:      Finds room for the next len bytes of output
+Parameters:   m - output map
+              scratch - buffer of len bytes for buffered output
+              len - most bytes about to be written
+Return:       where to build the output, NULL if the mapping is too small
+Notes:        bytes built in the mapping are only kept once map_write is
+              called on them
+******************************************************************************/
+unsigned char *map_reserve(map_file_t *m, unsigned char *scratch, size_t len) {
+    if (m->data == NULL) return scratch;
+    if (len > m->len - m->pos) return NULL;
+
+    return m->data + m->pos;
+}
+
+/* Appends len bytes to the output, bytes already in place from map_reserve
+ * are not copied again
+ *
+ * Return: 0 on success, -1 if the output is full or a write fails
+ */
+int map_write(map_file_t *m, const unsigned char *buf, size_t len) {
+    if (m->data == NULL) return fwrite(buf, 1, len, m->fpt) == len ? 0 : -1;
+    if (len > m->len - m->pos) return -1;
+
+    if (buf != m->data + m->pos) memcpy(m->data + m->pos, buf, len);
+    m->pos += len;
+    return 0;
+}
@@ -0,0 +1,30 @@
+//
+//  mapio.h
+//  API for memory-mapped file input and output
+//  files are coded in place in their mapping, pipes fall back to stdio
+//
+
+#ifndef MAPIO_H
+#define MAPIO_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef struct map_file_tag {
+    FILE *fpt;                  // underlying file, used directly when not mapped
+    unsigned char *data;        // mapping, NULL for buffered I/O
+    size_t len;                 // bytes mapped
+    size_t pos;                 // next byte to read or write
+} map_file_t;
+
+// public prototype definitions for mapio.c
+void map_memory(map_file_t *m, const void *buf, size_t len);
+void map_open_input(map_file_t *m, FILE *fpt);
+void map_close_input(map_file_t *m);
+size_t map_read(map_file_t *m, const unsigned char **buf, unsigned char *scratch, size_t len);
+void map_open_output(map_file_t *m, FILE *fpt, size_t cap);
+int map_close_output(map_file_t *m);
+unsigned char *map_reserve(map_file_t *m, unsigned char *scratch, size_t len);
+int map_write(map_file_t *m, const unsigned char *buf, size_t len);
+
+#endif
@@ -0,0 +1,369 @@
+//
+//  parallel.c
+//  API for multi-threaded block compression and decompression
+//  blocks are coded on a pool of threads and written back in order
+//
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+
+// slot states
+#define SLOT_FREE 0         // owned by the reader
+#define SLOT_READY 1        // read, waiting for or being coded by a worker
+#define SLOT_DONE 2         // coded, waiting to be written
+
+typedef struct parallel_slot_tag {
+    const unsigned char *in_buf;    // block in the input mapping or in buf
+    size_t in_len;
+    unsigned char *buf;             // read buffer for unmapped input
+    unsigned char *out_buf;
+    size_t out_len;
+    block_job_t job;
+    int state;
+} parallel_slot_t;
+
+typedef struct parallel_tag {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // broadcast on every change below
+    parallel_slot_t *slot;      // reorder buffer, block i lives in slot i % num_slots
+    int num_slots;
+    uint64_t num_read;          // blocks handed to the workers
+    uint64_t next_job;          // next block for a worker to take
+    uint64_t num_chosen;        // blocks whose table has been chosen
+    int quit;
+    block_encoder_t *enc;
+} parallel_t;
+
+// shared state of parallel_decompress
+typedef struct parallel_dec_tag {
+    pthread_mutex_t lock;
+    const block_index_t *idx;
+    uint64_t next_block;        // next block for a worker to take
+    const map_file_t *in;       // mapped archive
+    map_file_t *out;
+    size_t block_size;
+    int status;                 // -1 once any block fails
+} parallel_dec_t;
+
+// prototypes for private functions used in parallel.c only
+void *parallel_worker(void *);
+void *parallel_dec_worker(void *);
+const unsigned char *parallel_get_block(const map_file_t *, uint64_t, int *, size_t *, size_t *);
+int write_fully(int, const unsigned char *, size_t, uint64_t);
+
+/* Returns the number of threads to use for a -T argument, 0 meaning one
+ * per online CPU.
+ */
+int parallel_threads(int requested) {
+    long cpus;
+
+    if (requested > 0) return requested < PARALLEL_MAX_THREADS ? requested : PARALLEL_MAX_THREADS;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus < PARALLEL_MAX_THREADS ? cpus : PARALLEL_MAX_THREADS;
+}
+
+/******************************************************************************
+parallel_compress:
+Purpose:      Codes all blocks of a file on a pool of threads
+Parameters:   enc - encoder, carries the last table sent between blocks
+              idx - index, every block written is added
+              in - input, read block_size bytes at a time
+              out - output, receives the blocks in input order
+              block_size - bytes of input per block
+              num_threads - worker threads
+              in_len - receives the bytes read
+Return:       0 on success, -1 if out of memory or threads or a write fails
+Notes:        the calling thread reads and writes, workers take blocks in
+              order; the table choice of block i waits for block i - 1 so
+              the output is the same as block_compress would produce for
+              any number of threads
+******************************************************************************/
+int parallel_compress(block_encoder_t *enc, block_index_t *idx, map_file_t *in, map_file_t *out,
+                      size_t block_size, int num_threads, uint64_t *in_len) {
+    pthread_t thread[PARALLEL_MAX_THREADS];
+    uint64_t num_written = 0;
+    parallel_slot_t *s;
+    parallel_t par;
+    int i, started = 0, eof = 0, status = 0;
+    size_t n;
+
+    *in_len = 0;
+
+    par.num_slots = num_threads * PARALLEL_SLOTS_PER_THREAD;
+    par.slot = (parallel_slot_t *)calloc(par.num_slots, sizeof(parallel_slot_t));
+    if (par.slot == NULL) return -1;
+
+    par.num_read = par.next_job = par.num_chosen = 0;
+    par.quit = 0;
+    par.enc = enc;
+    pthread_mutex_init(&par.lock, NULL);
+    pthread_cond_init(&par.cond, NULL);
+
+    for (i = 0; i < par.num_slots; i++) {
+        if (in->data == NULL && (par.slot[i].buf = (unsigned char *)malloc(block_size)) == NULL) status = -1;
+        par.slot[i].out_buf = (unsigned char *)malloc(block_bound(block_size));
+        if (par.slot[i].out_buf == NULL) status = -1;
+    }
+
+    for (started = 0; status == 0 && started < num_threads; started++) {
+        if (pthread_create(&thread[started], NULL, parallel_worker, &par) != 0) {
+            status = -1;
+            break;
+        }
+    }
+
+    while (status == 0) {
+        // read the next block while there is a free slot
+        if (!eof && par.num_read - num_written < (uint64_t)par.num_slots) {
+            s = &par.slot[par.num_read % par.num_slots];
+            n = map_read(in, &s->in_buf, s->buf, block_size);
+
+            pthread_mutex_lock(&par.lock);
+            if (n == 0) {
+                eof = 1;
+            } else {
+                s->in_len = n;
+                s->state = SLOT_READY;
+                par.num_read++;
+                pthread_cond_broadcast(&par.cond);
+            }
+            pthread_mutex_unlock(&par.lock);
+
+            *in_len += n;
+            continue;
+        }
+
+        if (num_written == par.num_read) break;
+
+        // write out the oldest block once it is coded
+        s = &par.slot[num_written % par.num_slots];
+        pthread_mutex_lock(&par.lock);
+        while (s->state != SLOT_DONE) pthread_cond_wait(&par.cond, &par.lock);
+        pthread_mutex_unlock(&par.lock);
+
+        if (s->out_len == 0 || block_index_add(idx, s->out_buf) != 0 || map_write(out, s->out_buf, s->out_len) != 0)
+            status = -1;
+        s->state = SLOT_FREE;
+        num_written++;
+    }
+
+    pthread_mutex_lock(&par.lock);
+    par.quit = 1;
+    pthread_cond_broadcast(&par.cond);
+    pthread_mutex_unlock(&par.lock);
+
+    for (i = 0; i < started; i++) pthread_join(thread[i], NULL);
+
+    for (i = 0; i < par.num_slots; i++) {
+        free(par.slot[i].buf);
+        free(par.slot[i].out_buf);
+        block_job_free(&par.slot[i].job);
+    }
+
+    free(par.slot);
+    pthread_mutex_destroy(&par.lock);
+    pthread_cond_destroy(&par.cond);
+    return status;
+}
+
+/******************************************************************************
+parallel_worker:
+Purpose:      Codes blocks until told to quit
+Parameters:   arg - shared parallel_t
+Return:       NULL
+Notes:        analysis and encoding run unlocked, only the table choice is
+              serialized in block order
+******************************************************************************/
+void *parallel_worker(void *arg) {
+    parallel_t *par = (parallel_t *)arg;
+    parallel_slot_t *s;
+    uint64_t seq;
+    int failed;
+
+    pthread_mutex_lock(&par->lock);
+
+    for (;;) {
+        while (!par->quit && par->next_job == par->num_read)
+            pthread_cond_wait(&par->cond, &par->lock);
+
+        if (par->next_job == par->num_read) break;
+
+        seq = par->next_job++;
+        s = &par->slot[seq % par->num_slots];
+        pthread_mutex_unlock(&par->lock);
+
+        failed = block_analyze(&s->job, par->enc, s->in_buf, s->in_len) != 0;
+
+        // choose tables in block order, a failed block still takes its turn
+        pthread_mutex_lock(&par->lock);
+        while (par->num_chosen != seq) pthread_cond_wait(&par->cond, &par->lock);
+        if (!failed) block_choose(par->enc, &s->job);
+        par->num_chosen++;
+        pthread_cond_broadcast(&par->cond);
+        pthread_mutex_unlock(&par->lock);
+
+        s->out_len = failed ? 0 : block_encode(&s->job, s->in_buf, s->in_len, s->out_buf);
+
+        pthread_mutex_lock(&par->lock);
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&par->cond);
+    }
+
+    pthread_mutex_unlock(&par->lock);
+    return NULL;
+}
+
+/******************************************************************************
+parallel_decompress:
+Purpose:      Decodes all blocks of an archive on a pool of threads
+Parameters:   idx - index read from the archive
+              in - archive, must be mapped
+              out - output, holds idx->raw_len bytes afterwards
+              block_size - block size from the file header
+              num_threads - worker threads
+Return:       0 on success, -1 if a block is malformed or I/O fails
+Notes:        every worker writes its blocks straight to their place in the
+              output, into the mapping or with pwrite, so blocks finish in
+              any order
+******************************************************************************/
+int parallel_decompress(const block_index_t *idx, const map_file_t *in, map_file_t *out, size_t block_size,
+                        int num_threads) {
+    pthread_t thread[PARALLEL_MAX_THREADS];
+    parallel_dec_t par;
+    int i, started;
+
+    if (in->data == NULL) return -1;
+
+    if (out->data == NULL) {
+        if (fflush(out->fpt) != 0 || ftruncate(fileno(out->fpt), idx->raw_len) != 0) return -1;
+    } else if (out->len < idx->raw_len) {
+        return -1;
+    }
+
+    par.idx = idx;
+    par.next_block = 0;
+    par.in = in;
+    par.out = out;
+    par.block_size = block_size;
+    par.status = 0;
+    pthread_mutex_init(&par.lock, NULL);
+
+    for (started = 0; started < num_threads; started++) {
+        if (pthread_create(&thread[started], NULL, parallel_dec_worker, &par) != 0) break;
+    }
+
+    // no threads at all, decode on this one
+    if (started == 0) parallel_dec_worker(&par);
+
+    for (i = 0; i < started; i++) pthread_join(thread[i], NULL);
+
+    if (out->data != NULL) out->pos = idx->raw_len;
+
+    pthread_mutex_destroy(&par.lock);
+    return par.status;
+}
+
+/******************************************************************************
+parallel_dec_worker:
+Purpose:      Decodes blocks until none are left
+Parameters:   arg - shared parallel_dec_t
+Return:       NULL
+Notes:        keeps the lookup tables of the last table read, so runs of
+              blocks reusing one table only build it once per worker
+******************************************************************************/
+void *parallel_dec_worker(void *arg) {
+    parallel_dec_t *par = (parallel_dec_t *)arg;
+    const block_index_entry_t *e;
+    const unsigned char *payload, *table;
+    unsigned char *out_buf = NULL, *dst;
+    uint64_t table_offset = 0;
+    size_t raw_len, comp_len, table_len;
+    block_decoder_t dec;
+    int flags, table_flags, status = 0;
+    uint64_t i;
+
+    block_decoder_init(&dec);
+    if (par->out->data == NULL && (out_buf = (unsigned char *)malloc(par->block_size)) == NULL) status = -1;
+
+    while (status == 0) {
+        pthread_mutex_lock(&par->lock);
+        i = par->next_block++;
+        if (par->status != 0) i = par->idx->num_blocks;
+        pthread_mutex_unlock(&par->lock);
+
+        if (i >= par->idx->num_blocks) break;
+        e = &par->idx->entry[i];
+
+        payload = parallel_get_block(par->in, e->offset, &flags, &raw_len, &comp_len);
+        if (payload == NULL || raw_len != e->raw_len) {
+            status = -1;
+            break;
+        }
+
+        // block reuses a table, load it from the block that sent it
+        if (!(flags & (BLOCK_TABLE | BLOCK_RAW | BLOCK_CONTEXT)) && (!dec.have_table || table_offset != e->table_offset)) {
+            table = parallel_get_block(par->in, e->table_offset, &table_flags, &raw_len, &table_len);
+            if (table == NULL || !(table_flags & BLOCK_TABLE) || block_load_table(&dec, table, table_len) < 0) {
+                status = -1;
+                break;
+            }
+            table_offset = e->table_offset;
+        }
+
+        dst = out_buf ? out_buf : par->out->data + e->raw_offset;
+        if (block_decompress(&dec, flags, payload, comp_len, dst, e->raw_len) != 0 ||
+                (out_buf && write_fully(fileno(par->out->fpt), out_buf, e->raw_len, e->raw_offset) != 0)) {
+            status = -1;
+            break;
+        }
+
+        if (flags & BLOCK_TABLE) table_offset = e->offset;
+    }
+
+    if (status != 0) {
+        pthread_mutex_lock(&par->lock);
+        par->status = -1;
+        pthread_mutex_unlock(&par->lock);
+    }
+
+    block_decoder_free(&dec);
+    free(out_buf);
+    return NULL;
+}
+
+/******************************************************************************
+parallel_get_block:
+Purpose:      Finds a block of a mapped archive by its file offset
+Parameters:   in - mapped archive
+              offset - file offset of the block header
+              flags, raw_len, comp_len - receive the block header
+Return:       the payload, NULL if the block does not fit in the archive
+******************************************************************************/
+const unsigned char *parallel_get_block(const map_file_t *in, uint64_t offset, int *flags, size_t *raw_len,
+                                        size_t *comp_len) {
+    if (offset > in->len || in->len - offset < BLOCK_HEADER ||
+            block_read_header(in->data + offset, flags, raw_len, comp_len) != 0 ||
+            *comp_len > in->len - offset - BLOCK_HEADER)
+        return NULL;
+
+    return in->data + offset + BLOCK_HEADER;
+}
+
+// pwrite until len bytes are written, -1 on error
+int write_fully(int fd, const unsigned char *buf, size_t len, uint64_t offset) {
+    ssize_t n;
+
+    while (len > 0) {
+        n = pwrite(fd, buf, len, offset);
+        if (n <= 0) return -1;
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+
+    return 0;
+}
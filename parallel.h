@@ -0,0 +1,23 @@
+//
+//  parallel.h
+//  API for multi-threaded block compression and decompression
+//  blocks are coded on a pool of threads and written back in order
+//
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "block.h"
+#include "mapio.h"
+
+#define PARALLEL_MAX_THREADS 256
+#define PARALLEL_SLOTS_PER_THREAD 2     // blocks in flight per thread
+
+// public prototype definitions for parallel.c
+int parallel_threads(int requested);
+int parallel_compress(block_encoder_t *enc, block_index_t *idx, map_file_t *in, map_file_t *out,
+                      size_t block_size, int num_threads, uint64_t *in_len);
+int parallel_decompress(const block_index_t *idx, const map_file_t *in, map_file_t *out, size_t block_size,
+                        int num_threads);
+
+#endif
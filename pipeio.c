@@ -0,0 +1,163 @@
+//
+//  pipeio.c
+//  API for large-buffer reads and writes on pipes and descriptors
+//  output to a pipe is handed over with vmsplice instead of copied
+//
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "pipeio.h"
+
+// prototypes for private functions used in pipeio.c only
+int pipe_writer_flush(pipe_writer_t *);
+
+/* Asks for a pipe buffer of PIPE_BUF_SIZE bytes if fd is a pipe, so fewer
+ * and larger transfers cross it
+ */
+void pipe_grow(int fd) {
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) fcntl(fd, F_SETPIPE_SZ, PIPE_BUF_SIZE);
+}
+
+/******************************************************************************
+pipe_read:
+Purpose:      Reads until a buffer is full or the input ends
+Parameters:   fd - input
+              buf, len - buffer
+              n - receives the bytes read, less than len only at the end
+Return:       0 on success, -1 on a read error
+Notes:        a pipe returns what its writer has produced so far, reading
+              on until len bytes keeps the blocks fed to the coder large
+******************************************************************************/
+int pipe_read(int fd, unsigned char *buf, size_t len, size_t *n) {
+    ssize_t r;
+
+    *n = 0;
+
+    while (*n < len) {
+        r = read(fd, buf + *n, len - *n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r == 0) break;
+        *n += r;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+pipe_writer_init:
+Purpose:      Sets up double-buffered output to a descriptor
+Parameters:   pw - writer
+              fd - output
+Return:       0 on success, -1 if out of memory
+Notes:        vmsplice leaves the pages of a buffer in the pipe until the
+              reader takes them, so a buffer is only refilled after the
+              other one, at least a pipe's capacity long, went in behind it;
+              output that is not a pipe big enough for that is written
+******************************************************************************/
+int pipe_writer_init(pipe_writer_t *pw, int fd) {
+    struct stat st;
+    int i, capacity;
+
+    pw->fd = fd;
+    pw->cur = 0;
+    pw->size = PIPE_BUF_SIZE;
+    pw->len = 0;
+    pw->splice = 0;
+
+    // mapped rather than malloc'd so no later allocation can reuse pages
+    // the pipe may still hold
+    for (i = 0; i < 2; i++) {
+        pw->buf[i] = (unsigned char *)mmap(NULL, PIPE_BUF_SIZE, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pw->buf[i] == MAP_FAILED) {
+            if (i == 1) munmap(pw->buf[0], PIPE_BUF_SIZE);
+            return -1;
+        }
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        pipe_grow(fd);
+        capacity = fcntl(fd, F_GETPIPE_SZ);
+        pw->splice = capacity > 0 && (size_t)capacity <= pw->size;
+    }
+
+    return 0;
+}
+
+/* Returns where the next output goes and how many bytes fit there
+ */
+unsigned char *pipe_writer_space(pipe_writer_t *pw, size_t *avail) {
+    *avail = pw->size - pw->len;
+    return pw->buf[pw->cur] + pw->len;
+}
+
+/* Adds len bytes placed at pipe_writer_space to the output, sending the
+ * buffer on once it is full
+ *
+ * Return: 0 on success, -1 on a write error
+ */
+int pipe_writer_commit(pipe_writer_t *pw, size_t len) {
+    pw->len += len;
+
+    if (pw->len < pw->size) return 0;
+    return pipe_writer_flush(pw);
+}
+
+/* Sends what is left and releases the buffers
+ *
+ * Return: 0 on success, -1 on a write error
+ */
+int pipe_writer_end(pipe_writer_t *pw) {
+    int status = pipe_writer_flush(pw);
+
+    // pages handed to the pipe stay with it after unmapping
+    munmap(pw->buf[0], pw->size);
+    munmap(pw->buf[1], pw->size);
+    pw->buf[0] = pw->buf[1] = NULL;
+    return status;
+}
+
+/* Sends the current buffer and switches to the other one
+ *
+ * Return: 0 on success, -1 on a write error
+ */
+int pipe_writer_flush(pipe_writer_t *pw) {
+    unsigned char *p = pw->buf[pw->cur];
+    size_t left = pw->len;
+    struct iovec iov;
+    ssize_t n;
+
+    while (left > 0) {
+        if (pw->splice) {
+            iov.iov_base = p;
+            iov.iov_len = left;
+            n = vmsplice(pw->fd, &iov, 1, 0);
+
+            // pipe refuses splicing, fall back to copies
+            if (n < 0 && errno == EINVAL) {
+                pw->splice = 0;
+                continue;
+            }
+        } else {
+            n = write(pw->fd, p, left);
+        }
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+
+        p += n;
+        left -= n;
+    }
+
+    pw->cur ^= 1;
+    pw->len = 0;
+    return 0;
+}
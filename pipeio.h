@@ -0,0 +1,31 @@
+//
+//  pipeio.h
+//  API for large-buffer reads and writes on pipes and descriptors
+//  output to a pipe is handed over with vmsplice instead of copied
+//
+
+#ifndef PIPEIO_H
+#define PIPEIO_H
+
+#include <stddef.h>
+
+#define PIPE_BUF_SIZE (1 << 20)     // bytes per read and per write
+
+typedef struct pipe_writer_tag {
+    int fd;
+    unsigned char *buf[2];      // filled and written in turn
+    int cur;                    // buffer being filled
+    size_t size;                // bytes per buffer
+    size_t len;                 // bytes in the current buffer
+    int splice;                 // fd is a pipe that takes vmsplice
+} pipe_writer_t;
+
+// public prototype definitions for pipeio.c
+void pipe_grow(int fd);
+int pipe_read(int fd, unsigned char *buf, size_t len, size_t *n);
+int pipe_writer_init(pipe_writer_t *pw, int fd);
+unsigned char *pipe_writer_space(pipe_writer_t *pw, size_t *avail);
+int pipe_writer_commit(pipe_writer_t *pw, size_t len);
+int pipe_writer_end(pipe_writer_t *pw);
+
+#endif
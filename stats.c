@@ -0,0 +1,139 @@
+//
+//  stats.c
+//  API for optional per-stage instrumentation of the coding hot paths
+//  compiled out unless built with -DHUFF_STATS (make STATS=1)
+//
+
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STATS_CYCLES() __rdtsc()
+#else
+#define STATS_CYCLES() 0
+#endif
+
+const char *stats_stage_name[STATS_STAGES] = {
+    "histogram", "calc_freq", "list_sort", "build_tree", "build_codes", "encode", "read_table", "decode",
+    "context"
+};
+
+// a stage opened by stats_begin on this thread
+typedef struct stats_open_tag {
+    int stage;
+    uint64_t cycles;
+    uint64_t nsec;
+} stats_open_t;
+
+// totals over all threads, updated atomically
+static stats_stage_t stats_total[STATS_STAGES];
+
+// stages open on this thread, innermost last
+static __thread stats_open_t stats_open[STATS_MAX_DEPTH];
+static __thread int stats_depth;
+
+// prototypes for private functions used in stats.c only
+uint64_t stats_nsec(void);
+
+/* Returns 1 if the hot paths were built with instrumentation
+ */
+int stats_enabled(void) {
+#ifdef HUFF_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* Opens a stage on the calling thread; stages nest, and time spent in an
+ * inner stage also counts towards the outer one
+ */
+void stats_begin(int stage) {
+    stats_open_t *o;
+
+    // stages nested deeper than the stack holds go uncounted
+    if (stats_depth++ >= STATS_MAX_DEPTH) return;
+
+    o = &stats_open[stats_depth - 1];
+    o->stage = stage;
+    o->nsec = stats_nsec();
+    o->cycles = STATS_CYCLES();
+}
+
+/* Closes the innermost open stage, adding its time and bytes to the totals
+ */
+void stats_end(uint64_t bytes) {
+    uint64_t cycles = STATS_CYCLES(), nsec = stats_nsec();
+    stats_stage_t *t;
+    stats_open_t *o;
+
+    if (stats_depth == 0 || stats_depth-- > STATS_MAX_DEPTH) return;
+
+    o = &stats_open[stats_depth];
+    t = &stats_total[o->stage];
+    __atomic_fetch_add(&t->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&t->cycles, cycles - o->cycles, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&t->nsec, nsec - o->nsec, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&t->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/* Counts one heap allocation against the innermost open stage, if any
+ */
+void stats_alloc(void) {
+    if (stats_depth == 0 || stats_depth > STATS_MAX_DEPTH) return;
+
+    __atomic_fetch_add(&stats_total[stats_open[stats_depth - 1].stage].allocs, 1, __ATOMIC_RELAXED);
+}
+
+/* Copies the totals of every stage into stage[STATS_STAGES]
+ */
+void stats_get(stats_stage_t *stage) {
+    int s;
+
+    for (s = 0; s < STATS_STAGES; s++) {
+        stage[s].calls = __atomic_load_n(&stats_total[s].calls, __ATOMIC_RELAXED);
+        stage[s].cycles = __atomic_load_n(&stats_total[s].cycles, __ATOMIC_RELAXED);
+        stage[s].nsec = __atomic_load_n(&stats_total[s].nsec, __ATOMIC_RELAXED);
+        stage[s].bytes = __atomic_load_n(&stats_total[s].bytes, __ATOMIC_RELAXED);
+        stage[s].allocs = __atomic_load_n(&stats_total[s].allocs, __ATOMIC_RELAXED);
+    }
+}
+
+/******************************************************************************
+stats_report_json:
+Purpose:      Prints the stage totals and the peak memory of the process as
+              one JSON object on one line
+Parameters:   fpt - output
+Return:       void
+Notes:        peak_rss_kib is the largest resident set the process has had,
+              so it covers everything run so far, not only the coder
+******************************************************************************/
+void stats_report_json(FILE *fpt) {
+    stats_stage_t stage[STATS_STAGES];
+    struct rusage ru;
+    int s;
+
+    stats_get(stage);
+    memset(&ru, 0, sizeof(ru));
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(fpt, "{\"peak_rss_kib\":%ld,\"stages\":{", ru.ru_maxrss);
+    for (s = 0; s < STATS_STAGES; s++) {
+        fprintf(fpt, "%s\"%s\":{\"calls\":%llu,\"cycles\":%llu,\"wall_ns\":%llu,\"bytes\":%llu,\"allocs\":%llu}",
+                s ? "," : "", stats_stage_name[s], (unsigned long long)stage[s].calls,
+                (unsigned long long)stage[s].cycles, (unsigned long long)stage[s].nsec,
+                (unsigned long long)stage[s].bytes, (unsigned long long)stage[s].allocs);
+    }
+    fprintf(fpt, "}}\n");
+}
+
+// monotonic clock in nanoseconds
+uint64_t stats_nsec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
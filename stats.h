@@ -0,0 +1,55 @@
+//
+//  stats.h
+//  API for optional per-stage instrumentation of the coding hot paths
+//  compiled out unless built with -DHUFF_STATS (make STATS=1)
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// instrumented stages
+#define STATS_HISTOGRAM 0         // counting the symbols of a block
+#define STATS_CALC_FREQ 1         // listing the symbols present
+#define STATS_LIST_SORT 2         // sorting the list by frequency
+#define STATS_BUILD_TREE 3        // code lengths from the Huffman tree
+#define STATS_BUILD_CODES 4       // length limiting and canonical codes
+#define STATS_ENCODE 5            // bit packing
+#define STATS_READ_TABLE 6        // reading a code table and building its lookup tables
+#define STATS_DECODE 7            // symbol decoding
+#define STATS_CONTEXT 8           // counting and clustering the contexts of an order-1 block
+#define STATS_STAGES 9
+
+#define STATS_MAX_DEPTH 4         // stages open at once on one thread
+
+typedef struct stats_stage_tag {
+    uint64_t calls;
+    uint64_t cycles;              // time stamp counter ticks, 0 where there is none
+    uint64_t nsec;                // wall time
+    uint64_t bytes;               // input bytes the stage handled
+    uint64_t allocs;              // heap allocations made inside the stage
+} stats_stage_t;
+
+#ifdef HUFF_STATS
+#define STATS_BEGIN(stage) stats_begin(stage)
+#define STATS_END(bytes) stats_end(bytes)
+#define STATS_ALLOC() stats_alloc()
+#else
+#define STATS_BEGIN(stage) ((void)0)
+#define STATS_END(bytes) ((void)0)
+#define STATS_ALLOC() ((void)0)
+#endif
+
+extern const char *stats_stage_name[STATS_STAGES];
+
+// public prototype definitions for stats.c
+int stats_enabled(void);
+void stats_begin(int stage);
+void stats_end(uint64_t bytes);
+void stats_alloc(void);
+void stats_get(stats_stage_t *stage);
+void stats_report_json(FILE *fpt);
+
+#endif